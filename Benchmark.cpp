@@ -0,0 +1,789 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "Benchmark.h"
+
+#include <QCommandLineParser>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <optional>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+#include "SceneRenderer.h"
+#include "SoftwareRasterizer.h"
+#include "SceneSnapshot.h"
+#include "DemoScene.h"
+#include "StressScene.h"
+#include "SceneFile.h"
+#include "WallTrack.h"
+#include "Parallel.h"
+
+using RenderStrategyEnum = SceneRenderer::RenderStrategyEnum;
+
+struct BenchmarkSettings
+{
+    int width = 1280, height = 720;
+    GLsizei numOfSamples = 8;
+    int frames = 300, warmupFrames = 10;
+    std::vector<RenderStrategyEnum> strategies;
+    QString outputPath; // stdout if empty
+    enum class Format { CSV, JSON } format = Format::CSV;
+    SceneRenderer::DrawPathEnum drawPath = SceneRenderer::DrawPathEnum::Batched;
+    VertexPipelineEnum vertexPipeline = VertexPipelineEnum::VertexPulling;
+    SceneRenderer::CompositeEnum composite = SceneRenderer::CompositeEnum::EdgeAware;
+    int accumulationScale = 1;       // see SceneRenderer::Accumulation()
+    GLsizei accumulationSamples = 1;
+    std::vector<std::pair<SceneRenderer::TargetEnum, GLenum>> formats; // others are default
+    bool referenceError = false; // of the last frame against one with float32 targets
+    bool software = false;
+    unsigned threads = 0; // of the software rasterizer
+    QString imagesPrefix; // no images if empty
+    std::optional<StressSceneParams> stressScene; // the demo scene if empty
+    QString sceneFile; // loaded instead of the demo or stress scene if set
+    std::shared_ptr<const WallTrack> track; // animates the walls instead of the scene if set
+    double trackStepMs = 1000.0 / 60;
+    bool imageSequence = false; // save every measured frame rather than the last one
+};
+
+struct FrameTimeStats { double min = 0, p50 = 0, p99 = 0, mean = 0; }; // milliseconds
+
+// 8-bit levels of the image shown, the largest of the channels of a pixel
+struct ImageError { double mean = 0, rms = 0; int max = 0; };
+
+struct BenchmarkResult
+{
+    RenderStrategyEnum strategy;
+    FrameTimeStats wallClock;
+    std::optional<FrameTimeStats> gpu; // not for the software rasterizer
+
+    // Not for the software rasterizer either
+    QString formats; // of the targets the strategy renders to, e.g. "OpaqueColor=RGB10_A2"
+    std::optional<double> bytesPerPixel; // see SceneRenderer::BytesPerPixel()
+    std::array<std::optional<double>, GPUPassTimer::passCount> passMs{}; // averages
+    std::optional<ImageError> error; // with --bench-reference-error
+};
+
+class OffscreenGLContext : public GLContextOwner
+{
+public:
+    explicit OffscreenGLContext()
+    {
+        QSurfaceFormat format;
+        format.setMajorVersion(4); format.setMinorVersion(5);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+        format.setColorSpace(QSurfaceFormat::sRGBColorSpace);
+        context.setFormat(format);
+        context.setShareContext(QOpenGLContext::globalShareContext());
+        if (context.create())
+        {
+            surface.setFormat(context.format());
+            surface.create();
+        }
+
+        RegisterGLContextOwner(this);
+    }
+    ~OffscreenGLContext() override
+    {
+        bool current = MakeCurrent();
+        UnregisterGLContextOwner(this); // VAOs die with the context
+        if (current) context.doneCurrent();
+    }
+    OffscreenGLContext(const OffscreenGLContext & ) = delete;
+    OffscreenGLContext(      OffscreenGLContext &&) = delete;
+    OffscreenGLContext & operator=(const OffscreenGLContext & ) = delete;
+    OffscreenGLContext & operator=(      OffscreenGLContext &&) = delete;
+
+    bool IsValid() const
+    {
+        auto fmt = context.format();
+        return context.isValid() && surface.isValid() && SharesGLObjects(GLContext())
+               && (fmt.majorVersion() > 4 || (fmt.majorVersion() == 4 && fmt.minorVersion() >= 5));
+    }
+    bool MakeCurrent() { return IsValid() && context.makeCurrent(&surface); }
+
+    QOpenGLContext * GLContext() const override { return const_cast<QOpenGLContext *>(&context); }
+
+private:
+    QOpenGLContext context;
+    QOffscreenSurface surface;
+};
+
+
+
+static QTextStream & ErrStream() { static QTextStream s(stderr); return s; }
+
+bool BenchmarkRequested(int argc, char * argv[])
+{
+    for (int i = 1; i < argc; ++i)
+        if (std::strcmp(argv[i], "--bench") == 0) return true;
+    return false;
+}
+
+void PrepareHeadlessPlatform()
+{
+#ifdef Q_OS_LINUX
+    // Without a display the default xcb platform plugin aborts; -platform or
+    // QT_QPA_PLATFORM still take precedence
+    if (   qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")
+        && qEnvironmentVariableIsEmpty("DISPLAY")
+        && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY") )
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+#endif
+}
+
+void AddBenchmarkOptions(QCommandLineParser & parser)
+{
+    parser.addOption({ QStringLiteral("bench"),
+                       QStringLiteral("Render the demo scene offscreen with every strategy "
+                                      "and report frame times instead of showing the window.") });
+    parser.addOption({ QStringLiteral("bench-frames"),
+                       QStringLiteral("Number of measured frames per strategy."),
+                       QStringLiteral("n"), QStringLiteral("300") });
+    parser.addOption({ QStringLiteral("bench-warmup"),
+                       QStringLiteral("Number of frames rendered before measuring."),
+                       QStringLiteral("n"), QStringLiteral("10") });
+    parser.addOption({ QStringLiteral("bench-size"),
+                       QStringLiteral("Framebuffer size."),
+                       QStringLiteral("WxH"), QStringLiteral("1280x720") });
+    parser.addOption({ QStringLiteral("bench-samples"),
+                       QStringLiteral("MSAA sample count."),
+                       QStringLiteral("n"), QStringLiteral("8") });
+    parser.addOption({ QStringLiteral("bench-strategies"),
+                       QStringLiteral("Comma separated list of strategies: "
+                                      "WBOIT, WBOITLog, CODB, Additive, AdditiveEP "
+                                      "(default: all)."),
+                       QStringLiteral("list") });
+    parser.addOption({ QStringLiteral("bench-output"),
+                       QStringLiteral("Output file (default: stdout)."),
+                       QStringLiteral("file") });
+    parser.addOption({ QStringLiteral("bench-format"),
+                       QStringLiteral("csv or json (default: json for *.json output files, "
+                                      "csv otherwise)."),
+                       QStringLiteral("format") });
+    parser.addOption({ QStringLiteral("bench-draw-path"),
+                       QStringLiteral("PerWall or Batched (default)."),
+                       QStringLiteral("path"), QStringLiteral("Batched") });
+    parser.addOption({ QStringLiteral("bench-vertex-pipeline"),
+                       QStringLiteral("GeometryShader or VertexPulling (default)."),
+                       QStringLiteral("pipeline"), QStringLiteral("VertexPulling") });
+    parser.addOption({ QStringLiteral("bench-composite"),
+                       QStringLiteral("Shading of the composite of WBOIT(Log) and AdditiveEP: "
+                                      "PerSample or EdgeAware (default)."),
+                       QStringLiteral("shading"), QStringLiteral("EdgeAware") });
+    parser.addOption({ QStringLiteral("bench-accumulation-scale"),
+                       QStringLiteral("Accumulate transparent walls of WBOIT(Log) and AdditiveEP "
+                                      "at 1/n of the resolution: 1, 2 or 4."),
+                       QStringLiteral("n"), QStringLiteral("1") });
+    parser.addOption({ QStringLiteral("bench-accumulation-samples"),
+                       QStringLiteral("MSAA sample count of accumulation at a reduced "
+                                      "resolution."),
+                       QStringLiteral("n"), QStringLiteral("1") });
+    parser.addOption({ QStringLiteral("bench-target-formats"),
+                       QStringLiteral("Comma separated target=format pairs, e.g. "
+                                      "WBOITColor=RGBA8,WBOITRevealage=R8. Targets: OpaqueColor, "
+                                      "WBOITColor, WBOITRevealage, AdditiveEPColor."),
+                       QStringLiteral("list") });
+    parser.addOption({ QStringLiteral("bench-reference-error"),
+                       QStringLiteral("Render the last frame of every strategy again with float32 "
+                                      "targets at full resolution and report the error of the "
+                                      "frame against it.") });
+    parser.addOption({ QStringLiteral("bench-software"),
+                       QStringLiteral("Use the multithreaded software rasterizer instead of "
+                                      "OpenGL. Only wall clock times are reported.") });
+    parser.addOption({ QStringLiteral("bench-threads"),
+                       QStringLiteral("Threads of the software rasterizer (0: all cores)."),
+                       QStringLiteral("n"), QStringLiteral("0") });
+    parser.addOption({ QStringLiteral("bench-images"),
+                       QStringLiteral("Save the last frame of every strategy to "
+                                      "<prefix><strategy>.png."),
+                       QStringLiteral("prefix") });
+    parser.addOption({ QStringLiteral("bench-image-sequence"),
+                       QStringLiteral("With --bench-images, save every measured frame to "
+                                      "<prefix><strategy>_<frame>.png.") });
+    parser.addOption({ QStringLiteral("bench-track"),
+                       QStringLiteral("Play a wall track recorded from the Track menu instead of "
+                                      "the animation of the scene; --bench-frames defaults to "
+                                      "the frames of the whole track."),
+                       QStringLiteral("file") });
+    parser.addOption({ QStringLiteral("bench-track-step"),
+                       QStringLiteral("Track time between frames, in milliseconds."),
+                       QStringLiteral("ms"), QStringLiteral("16.667") });
+}
+
+static bool ParseInt(const QString & str, int min, int & out)
+{
+    bool ok = false;
+    int v = str.toInt(&ok);
+    if (!ok || v < min) return false;
+    out = v;
+    return true;
+}
+
+// Returns an error message or an empty string on success
+static QString ParseBenchmarkSettings(const QCommandLineParser & parser, BenchmarkSettings & s)
+{
+    if (!ParseInt(parser.value(QStringLiteral("bench-frames")), 1, s.frames))
+        return QStringLiteral("--bench-frames must be a positive integer");
+    if (!ParseInt(parser.value(QStringLiteral("bench-warmup")), 0, s.warmupFrames))
+        return QStringLiteral("--bench-warmup must be a non-negative integer");
+
+    auto size = parser.value(QStringLiteral("bench-size")).toLower().split('x');
+    if (   size.size() != 2 || !ParseInt(size[0], 1, s.width )
+                            || !ParseInt(size[1], 1, s.height) )
+        return QStringLiteral("--bench-size must look like 1920x1080");
+
+    if (!ParseInt(parser.value(QStringLiteral("bench-samples")), 1, s.numOfSamples))
+        return QStringLiteral("--bench-samples must be a positive integer");
+
+    if (parser.isSet(QStringLiteral("bench-strategies")))
+    {
+        for (auto & name : parser.value(QStringLiteral("bench-strategies")).split(','))
+        {
+            auto it = std::find_if( std::begin(SceneRenderer::allStrategies),
+                                    std::end  (SceneRenderer::allStrategies),
+                                    [n = name.trimmed().toLower()](RenderStrategyEnum st)
+                                    { return QString(SceneRenderer::StrategyName(st))
+                                             .toLower() == n; }                             );
+            if (it == std::end(SceneRenderer::allStrategies))
+                return QStringLiteral("Unknown strategy: ") + name;
+            s.strategies.push_back(*it);
+        }
+    }
+    else s.strategies.assign( std::begin(SceneRenderer::allStrategies),
+                              std::end  (SceneRenderer::allStrategies) );
+
+    s.outputPath = parser.value(QStringLiteral("bench-output"));
+    auto format = parser.value(QStringLiteral("bench-format")).toLower();
+    if (format.isEmpty())
+        s.format = s.outputPath.toLower().endsWith(QStringLiteral(".json"))
+                   ? BenchmarkSettings::Format::JSON : BenchmarkSettings::Format::CSV;
+    else if (format == QStringLiteral("csv" )) s.format = BenchmarkSettings::Format::CSV;
+    else if (format == QStringLiteral("json")) s.format = BenchmarkSettings::Format::JSON;
+    else return QStringLiteral("--bench-format must be csv or json");
+
+    auto drawPath = parser.value(QStringLiteral("bench-draw-path")).toLower();
+    auto it_path = std::find_if( std::begin(SceneRenderer::allDrawPaths),
+                                 std::end  (SceneRenderer::allDrawPaths),
+                                 [&drawPath](SceneRenderer::DrawPathEnum p)
+                                 { return QString(SceneRenderer::DrawPathName(p)).toLower()
+                                          == drawPath; }                                     );
+    if (it_path == std::end(SceneRenderer::allDrawPaths))
+        return QStringLiteral("--bench-draw-path must be PerWall or Batched");
+    s.drawPath = *it_path;
+
+    auto pipeline = parser.value(QStringLiteral("bench-vertex-pipeline")).toLower();
+    auto it_pipeline = std::find_if( std::begin(SceneRenderer::allVertexPipelines),
+                                     std::end  (SceneRenderer::allVertexPipelines),
+                                     [&pipeline](VertexPipelineEnum p)
+                                     { return QString(SceneRenderer::VertexPipelineName(p))
+                                              .toLower() == pipeline; }                      );
+    if (it_pipeline == std::end(SceneRenderer::allVertexPipelines))
+        return QStringLiteral("--bench-vertex-pipeline must be GeometryShader or VertexPulling");
+    s.vertexPipeline = *it_pipeline;
+
+    auto composite = parser.value(QStringLiteral("bench-composite")).toLower();
+    auto it_composite = std::find_if( std::begin(SceneRenderer::allComposites),
+                                      std::end  (SceneRenderer::allComposites),
+                                      [&composite](SceneRenderer::CompositeEnum c)
+                                      { return QString(SceneRenderer::CompositeName(c))
+                                               .toLower() == composite; }              );
+    if (it_composite == std::end(SceneRenderer::allComposites))
+        return QStringLiteral("--bench-composite must be PerSample or EdgeAware");
+    s.composite = *it_composite;
+
+    auto scale = parser.value(QStringLiteral("bench-accumulation-scale"));
+    if (   !ParseInt(scale, 1, s.accumulationScale)
+        || std::find( std::begin(SceneRenderer::allAccumulationScales),
+                      std::end  (SceneRenderer::allAccumulationScales), s.accumulationScale )
+           == std::end(SceneRenderer::allAccumulationScales)                                )
+        return QStringLiteral("--bench-accumulation-scale must be 1, 2 or 4");
+    if (!ParseInt(parser.value(QStringLiteral("bench-accumulation-samples")), 1,
+                  s.accumulationSamples                                        ))
+        return QStringLiteral("--bench-accumulation-samples must be a positive integer");
+
+    for (auto & pair : parser.value(QStringLiteral("bench-target-formats")).split(','))
+    {
+        if (pair.trimmed().isEmpty()) continue;
+        auto kv = pair.split('=');
+        if (kv.size() != 2) return QStringLiteral("--bench-target-formats must look like "
+                                                  "WBOITColor=RGBA8,WBOITRevealage=R8");
+        auto target = kv[0].trimmed().toLower(), format = kv[1].trimmed().toLower();
+        auto it_target = std::find_if( std::begin(SceneRenderer::allTargets),
+                                       std::end  (SceneRenderer::allTargets),
+                                       [&target](SceneRenderer::TargetEnum t)
+                                       { return QString(SceneRenderer::TargetName(t)).toLower()
+                                                == target; }                                  );
+        if (it_target == std::end(SceneRenderer::allTargets))
+            return QStringLiteral("Unknown target: ") + kv[0];
+        auto & formats = SceneRenderer::TargetFormats(*it_target);
+        auto it_format = std::find_if( formats.begin(), formats.end(),
+                                       [&format](GLenum f)
+                                       { return QString(SceneRenderer::FormatName(f)).toLower()
+                                                == format; }                                  );
+        if (it_format == formats.end())
+        {
+            QStringList names;
+            for (auto f : formats) names.append(SceneRenderer::FormatName(f));
+            return QStringLiteral("%1 takes %2").arg(kv[0], names.join(QStringLiteral(", ")));
+        }
+        s.formats.emplace_back(*it_target, *it_format);
+    }
+    s.referenceError = parser.isSet(QStringLiteral("bench-reference-error"));
+
+    s.software = parser.isSet(QStringLiteral("bench-software"));
+    if (s.software && s.accumulationScale != 1)
+        return QStringLiteral("The software rasterizer accumulates at full resolution only");
+    if (s.software && (!s.formats.empty() || s.referenceError))
+        return QStringLiteral("--bench-target-formats and --bench-reference-error "
+                              "need OpenGL rather than the software rasterizer");
+    int threads = 0;
+    if (!ParseInt(parser.value(QStringLiteral("bench-threads")), 0, threads))
+        return QStringLiteral("--bench-threads must be a non-negative integer");
+    s.threads = static_cast<unsigned>(threads);
+    s.imagesPrefix = parser.value(QStringLiteral("bench-images"));
+    s.imageSequence = parser.isSet(QStringLiteral("bench-image-sequence"));
+    if (s.imageSequence && s.imagesPrefix.isEmpty())
+        return QStringLiteral("--bench-image-sequence needs --bench-images");
+
+    if (parser.isSet(QStringLiteral("stress-scene")))
+    {
+        auto error = ParseStressSceneParams( parser.value(QStringLiteral("stress-scene")),
+                                             s.stressScene.emplace()                      );
+        if (!error.isEmpty()) return QStringLiteral("--stress-scene: ") + error;
+    }
+    s.sceneFile = parser.value(QStringLiteral("scene-file"));
+    if (s.stressScene && !s.sceneFile.isEmpty())
+        return QStringLiteral("--stress-scene and --scene-file can't be used together");
+
+    if (parser.isSet(QStringLiteral("bench-track")))
+    {
+        auto track = std::make_shared<WallTrack>();
+        auto error = track->Load(parser.value(QStringLiteral("bench-track")));
+        if (!error.isEmpty()) return error;
+        bool ok = false;
+        s.trackStepMs = parser.value(QStringLiteral("bench-track-step")).toDouble(&ok);
+        if (!ok || !(s.trackStepMs > 0))
+            return QStringLiteral("--bench-track-step must be a positive number");
+        if (!parser.isSet(QStringLiteral("bench-frames")))
+            s.frames = track->FrameCount(s.trackStepMs);
+        s.track = std::move(track);
+    }
+
+    return {};
+}
+
+// Returns an error message or an empty string on success
+static QString InitWalls(const BenchmarkSettings & s)
+{
+    if (!s.sceneFile.isEmpty())
+    {
+        auto error = LoadSceneFile(s.sceneFile);
+        if (!error.isEmpty()) return error;
+    }
+    else if (s.stressScene) InitStressWalls(*s.stressScene);
+    else InitDemoWalls();
+
+    if (s.track && !s.track->FitsScene())
+        return QStringLiteral("The track was recorded with a scene of another count of walls");
+    return {};
+}
+
+// Frames are numbered from 0; warm-up frames show frame 0
+static void UpdateWalls(const BenchmarkSettings & s, int frame)
+{
+    if (s.track) { s.track->Apply(frame * s.trackStepMs); return; }
+    if (!s.sceneFile.isEmpty()) return; // scene files are static
+    auto p = static_cast<float>(frame) / s.frames;
+    if (s.stressScene) UpdateStressWalls(p); else UpdateDemoWalls(p);
+}
+
+static QString SceneName(const BenchmarkSettings & s)
+{
+    if (!s.sceneFile.isEmpty()) return s.sceneFile;
+    return s.stressScene ? StressSceneSpec(*s.stressScene) : QStringLiteral("Demo");
+}
+
+static FrameTimeStats CalcStats(std::vector<double> ms)
+{
+    FrameTimeStats ret;
+    if (ms.empty()) return ret;
+    std::sort(ms.begin(), ms.end());
+    auto percentile = [&ms](double p) // nearest rank
+    {
+        auto rank = static_cast<size_t>(std::ceil(p * ms.size()));
+        return ms[std::clamp<size_t>(rank, 1, ms.size()) - 1];
+    };
+    ret.min = ms.front();
+    ret.p50 = percentile(0.50);
+    ret.p99 = percentile(0.99);
+    double sum = 0; for (auto v : ms) sum += v;
+    ret.mean = sum / ms.size();
+    return ret;
+}
+
+// frame is -1 for the last frame of a strategy
+static bool SaveImage( const QImage & image, const BenchmarkSettings & s,
+                       RenderStrategyEnum strategy, int frame = -1       )
+{
+    auto path = s.imagesPrefix + SceneRenderer::StrategyName(strategy);
+    if (frame >= 0) path += QStringLiteral("_%1").arg(frame, 5, 10, QChar('0'));
+    path += QStringLiteral(".png");
+    if (image.save(path)) return true;
+    ErrStream() << "Can't save " << path << '\n';
+    return false;
+}
+
+// Both return nothing if an image of --bench-image-sequence can't be saved
+static std::optional<BenchmarkResult> BenchmarkStrategy( RenderStrategyEnum strategy,
+                                                         const BenchmarkSettings & s,
+                                                         QOpenGLFramebufferObject & fbo )
+{
+    auto f = GLFunctions();
+
+    SceneRenderer renderer(strategy, s.numOfSamples);
+    renderer.DrawPath(s.drawPath);
+    renderer.VertexPipeline(s.vertexPipeline);
+    renderer.Composite(s.composite);
+    renderer.GenGLResources();
+    renderer.Accumulation(s.accumulationScale, s.accumulationSamples);
+    for (auto & [target, format] : s.formats) renderer.TargetFormat(target, format);
+    renderer.Resize(s.width, s.height);
+    renderer.WarmUpPrograms(); // linked by the first warm-up frame at the latest
+
+    // Timestamps rather than GL_TIME_ELAPSED: they don't conflict with queries
+    // issued inside the renderer
+    GLuint queries[2];
+    f->glGenQueries(2, queries);
+
+    std::vector<double> wallMs, gpuMs;
+    wallMs.reserve(static_cast<size_t>(s.frames));
+    gpuMs .reserve(static_cast<size_t>(s.frames));
+    for (int i = -s.warmupFrames; i < s.frames; ++i)
+    {
+        UpdateWalls(s, std::max(i, 0));
+
+        QElapsedTimer timer;
+        timer.start();
+        f->glQueryCounter(queries[0], GL_TIMESTAMP);
+        renderer.Render(fbo.handle());
+        f->glQueryCounter(queries[1], GL_TIMESTAMP);
+        f->glFinish(); // a frame is done when the GPU is done with it
+        auto wallNs = timer.nsecsElapsed();
+
+        GLuint64 begin = 0, end = 0;
+        f->glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+        f->glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end  );
+        renderer.CollectPassTimings();
+
+        if (i < 0) continue;
+        wallMs.push_back(static_cast<double>(wallNs     ) * 1e-6);
+        gpuMs .push_back(static_cast<double>(end - begin) * 1e-6);
+        // toImage() resolves the multisampled framebuffer
+        if (s.imageSequence && !SaveImage(fbo.toImage(), s, strategy, i)) break;
+    }
+
+    f->glDeleteQueries(2, queries);
+
+    if (wallMs.size() != static_cast<size_t>(s.frames)) return std::nullopt;
+    BenchmarkResult ret{};
+    ret.strategy = strategy;
+    ret.wallClock = CalcStats(std::move(wallMs));
+    ret.gpu = CalcStats(std::move(gpuMs));
+    QStringList formats;
+    for (auto target : SceneRenderer::StrategyTargets(strategy))
+        formats.append(QStringLiteral("%1=%2").arg( SceneRenderer::TargetName(target),
+                                                    SceneRenderer::FormatName(
+                                                        renderer.TargetFormat(target)) ));
+    ret.formats = formats.join(';');
+    ret.bytesPerPixel = renderer.BytesPerPixel();
+    ret.passMs = renderer.PassTimer().Averages();
+    renderer.DeleteGLResources();
+    return ret;
+}
+
+static ImageError CompareImages(const QImage & a, const QImage & b)
+{
+    auto ca = a.convertToFormat(QImage::Format_RGBA8888),
+         cb = b.convertToFormat(QImage::Format_RGBA8888);
+    assert(ca.size() == cb.size());
+
+    ImageError ret;
+    double sum = 0, sumSq = 0;
+    for (int y = 0; y != ca.height(); ++y)
+    {
+        auto la = ca.constScanLine(y), lb = cb.constScanLine(y);
+        for (int x = 0; x != ca.width(); ++x)
+        {
+            int err = 0;
+            for (int c = 0; c != 3; ++c) err = std::max(err, std::abs(la[4 * x + c] - lb[4 * x + c]));
+            sum += err; sumSq += static_cast<double>(err) * err;
+            ret.max = std::max(ret.max, err);
+        }
+    }
+    auto count = static_cast<double>(ca.width()) * ca.height();
+    if (count > 0) { ret.mean = sum / count; ret.rms = std::sqrt(sumSq / count); }
+    return ret;
+}
+
+// The frame in fbo against the same frame rendered with float32 targets at full resolution
+static ImageError ReferenceError( RenderStrategyEnum strategy, const BenchmarkSettings & s,
+                                  QOpenGLFramebufferObject & fbo                           )
+{
+    auto frame = fbo.toImage();
+
+    SceneRenderer reference(strategy, s.numOfSamples);
+    reference.DrawPath(s.drawPath);
+    reference.VertexPipeline(s.vertexPipeline);
+    reference.Composite(SceneRenderer::CompositeEnum::PerSample);
+    reference.GenGLResources();
+    for (auto target : SceneRenderer::allTargets)
+        reference.TargetFormat(target, SceneRenderer::ReferenceFormat(target));
+    reference.Resize(s.width, s.height);
+    reference.Render(fbo.handle());
+    GLFunctions()->glFinish();
+    reference.DeleteGLResources();
+
+    return CompareImages(frame, fbo.toImage());
+}
+
+static std::optional<BenchmarkResult> BenchmarkStrategySoftware( RenderStrategyEnum strategy,
+                                                                 const BenchmarkSettings & s,
+                                                                 QImage & lastFrame           )
+{
+    SoftwareRasterizer rasterizer(strategy, s.numOfSamples, s.threads);
+
+    std::vector<double> wallMs;
+    wallMs.reserve(static_cast<size_t>(s.frames));
+    for (int i = -s.warmupFrames; i < s.frames; ++i)
+    {
+        UpdateWalls(s, std::max(i, 0));
+        auto scene = SceneSnapshot::FromGlassWalls(); // the GL path has it in buffers already
+
+        QElapsedTimer timer;
+        timer.start();
+        lastFrame = rasterizer.Render(scene, s.width, s.height);
+        auto wallNs = timer.nsecsElapsed();
+
+        if (i < 0) continue;
+        wallMs.push_back(static_cast<double>(wallNs) * 1e-6);
+        if (s.imageSequence && !SaveImage(lastFrame, s, strategy, i)) return std::nullopt;
+    }
+
+    BenchmarkResult ret{};
+    ret.strategy = strategy;
+    ret.wallClock = CalcStats(std::move(wallMs));
+    return ret;
+}
+
+static const char * DrawPathName(const BenchmarkSettings & s)
+{ return s.software ? "Software" : SceneRenderer::DrawPathName(s.drawPath); }
+
+static const char * VertexPipelineName(const BenchmarkSettings & s)
+{ return s.software ? "Software" : SceneRenderer::VertexPipelineName(s.vertexPipeline); }
+
+static const char * CompositeName(const BenchmarkSettings & s)
+{ return s.software ? "Software" : SceneRenderer::CompositeName(s.composite); }
+
+static GLsizei AccumulationSamples(const BenchmarkSettings & s)
+{ return s.accumulationScale == 1 ? s.numOfSamples : s.accumulationSamples; }
+
+static void WriteCSV( QTextStream & out, const BenchmarkSettings & s,
+                      const std::vector<BenchmarkResult> & results )
+{
+    out << "strategy,draw_path,vertex_pipeline,composite,scene,width,height,samples,"
+           "accumulation_scale,accumulation_samples,formats,bytes_per_pixel,frames,"
+           "wall_min_ms,wall_p50_ms,wall_p99_ms,wall_mean_ms,"
+           "gpu_min_ms,gpu_p50_ms,gpu_p99_ms,gpu_mean_ms";
+    for (size_t p = 0; p != GPUPassTimer::passCount; ++p)
+        out << ',' << GPUPassTimer::PassName(static_cast<GPUPassTimer::Pass>(p)) << "_ms";
+    out << ",error_mean,error_rms,error_max\n";
+    for (auto & r : results)
+    {
+        out << SceneRenderer::StrategyName(r.strategy) << ','
+            << DrawPathName(s) << ',' << VertexPipelineName(s) << ','
+            << CompositeName(s) << ','
+            << '"' << SceneName(s) << "\","
+            << s.width << ',' << s.height << ',' << s.numOfSamples << ','
+            << s.accumulationScale << ',' << AccumulationSamples(s) << ','
+            << '"' << r.formats << "\",";
+        if (r.bytesPerPixel) out << *r.bytesPerPixel;
+        out << ',' << s.frames;
+        auto & wc = r.wallClock;
+        out << ',' << wc.min << ',' << wc.p50 << ',' << wc.p99 << ',' << wc.mean;
+        if (r.gpu) out << ',' << r.gpu->min << ',' << r.gpu->p50 << ','
+                       << r.gpu->p99 << ',' << r.gpu->mean;
+        else       out << ",,,,";
+        for (auto & ms : r.passMs)
+        {
+            out << ',';
+            if (ms) out << *ms;
+        }
+        if (r.error) out << ',' << r.error->mean << ',' << r.error->rms << ',' << r.error->max;
+        else         out << ",,,";
+        out << '\n';
+    }
+}
+
+static void WriteJSON( QTextStream & out, const BenchmarkSettings & s,
+                       const std::vector<BenchmarkResult> & results, const QString & glRenderer )
+{
+    auto statsToJson = [](const FrameTimeStats & st)
+    {
+        return QJsonObject{ { QStringLiteral("min_ms" ), st.min  },
+                            { QStringLiteral("p50_ms" ), st.p50  },
+                            { QStringLiteral("p99_ms" ), st.p99  },
+                            { QStringLiteral("mean_ms"), st.mean }  };
+    };
+    QJsonArray jResults;
+    for (auto & r : results)
+    {
+        QJsonObject jResult{
+            { QStringLiteral("strategy"  ), SceneRenderer::StrategyName(r.strategy) },
+            { QStringLiteral("wall_clock"), statsToJson(r.wallClock)               }  };
+        if (r.gpu) jResult.insert(QStringLiteral("gpu"), statsToJson(*r.gpu));
+        if (r.bytesPerPixel)
+        {
+            jResult.insert(QStringLiteral("formats"), r.formats);
+            jResult.insert(QStringLiteral("bytes_per_pixel"), *r.bytesPerPixel);
+        }
+        QJsonObject jPasses;
+        for (size_t p = 0; p != GPUPassTimer::passCount; ++p)
+            if (r.passMs[p])
+                jPasses.insert( QString(GPUPassTimer::PassName(static_cast<GPUPassTimer::Pass>(p)))
+                                + QStringLiteral("_ms"), *r.passMs[p]                              );
+        if (!jPasses.isEmpty()) jResult.insert(QStringLiteral("passes"), jPasses);
+        if (r.error)
+            jResult.insert(QStringLiteral("error"),
+                           QJsonObject{ { QStringLiteral("mean"), r.error->mean },
+                                        { QStringLiteral("rms" ), r.error->rms  },
+                                        { QStringLiteral("max" ), r.error->max  }  });
+        jResults.append(jResult);
+    }
+
+    QJsonObject root{ { QStringLiteral("renderer"), glRenderer       },
+                      { QStringLiteral("draw_path"), DrawPathName(s)    },
+                      { QStringLiteral("vertex_pipeline"), VertexPipelineName(s) },
+                      { QStringLiteral("composite"), CompositeName(s) },
+                      { QStringLiteral("scene"   ), SceneName(s)     },
+                      { QStringLiteral("width"   ), s.width          },
+                      { QStringLiteral("height"  ), s.height         },
+                      { QStringLiteral("samples" ), s.numOfSamples   },
+                      { QStringLiteral("accumulation_scale"  ), s.accumulationScale      },
+                      { QStringLiteral("accumulation_samples"), AccumulationSamples(s) },
+                      { QStringLiteral("frames"  ), s.frames         },
+                      { QStringLiteral("results" ), jResults         }  };
+    out << QJsonDocument(root).toJson();
+}
+
+// Both return process exit code
+static int RunGL( const BenchmarkSettings & s, QString & renderer,
+                  std::vector<BenchmarkResult> & results     )
+{
+    OffscreenGLContext context;
+    if (!context.MakeCurrent())
+    { ErrStream() << "Can't create an OpenGL 4.5 core offscreen context\n"; return 1; }
+
+    auto f = GLFunctions();
+    GLint maxSamples = 0;
+    f->glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    if (s.numOfSamples > maxSamples)
+    {
+        ErrStream() << "--bench-samples exceeds GL_MAX_SAMPLES (" << maxSamples << ")\n";
+        return 1;
+    }
+    if (s.accumulationSamples > maxSamples)
+    {
+        ErrStream() << "--bench-accumulation-samples exceeds GL_MAX_SAMPLES ("
+                    << maxSamples << ")\n";
+        return 1;
+    }
+    renderer = QString::fromLatin1(reinterpret_cast<const char *>(f->glGetString(GL_RENDERER)));
+    ErrStream() << "Renderer: " << renderer << '\n';
+
+    auto error = InitWalls(s);
+    if (!error.isEmpty()) { ErrStream() << error << '\n'; return 1; }
+    if (!context.MakeCurrent()) return 1;
+
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setSamples(s.numOfSamples);
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setInternalTextureFormat(GL_SRGB8_ALPHA8);
+    QOpenGLFramebufferObject fbo(s.width, s.height, fboFormat);
+    if (!fbo.isValid()) { ErrStream() << "Can't create the framebuffer\n"; return 1; }
+
+    f->glDisable(GL_FRAMEBUFFER_SRGB);
+    for (auto strategy : s.strategies)
+    {
+        ErrStream() << "Benchmarking " << SceneRenderer::StrategyName(strategy) << "...\n";
+        ErrStream().flush();
+        auto result = BenchmarkStrategy(strategy, s, fbo);
+        if (!result) return 1;
+        if (   !s.imagesPrefix.isEmpty() && !s.imageSequence
+            && !SaveImage(fbo.toImage(), s, strategy)      ) return 1;
+        if (s.referenceError) result->error = ReferenceError(strategy, s, fbo);
+        results.push_back(*result);
+    }
+    return 0;
+}
+
+static int RunSoftware( const BenchmarkSettings & s, QString & renderer,
+                        std::vector<BenchmarkResult> & results        )
+{
+    renderer = QStringLiteral("software, %1 threads").arg(WorkerCount(s.threads));
+    ErrStream() << "Renderer: " << renderer << '\n';
+
+    auto error = InitWalls(s);
+    if (!error.isEmpty()) { ErrStream() << error << '\n'; return 1; }
+    for (auto strategy : s.strategies)
+    {
+        ErrStream() << "Benchmarking " << SceneRenderer::StrategyName(strategy) << "...\n";
+        ErrStream().flush();
+        QImage lastFrame;
+        auto result = BenchmarkStrategySoftware(strategy, s, lastFrame);
+        if (!result) return 1;
+        results.push_back(*result);
+        if (   !s.imagesPrefix.isEmpty() && !s.imageSequence
+            && !SaveImage(lastFrame, s, strategy)          ) return 1;
+    }
+    return 0;
+}
+
+int RunBenchmark(const QCommandLineParser & parser)
+{
+    BenchmarkSettings s;
+    auto error = ParseBenchmarkSettings(parser, s);
+    if (!error.isEmpty()) { ErrStream() << error << '\n'; return 1; }
+
+    QString renderer;
+    std::vector<BenchmarkResult> results;
+    if (auto ret = s.software ? RunSoftware(s, renderer, results) : RunGL(s, renderer, results))
+        return ret;
+
+    QFile file;
+    if (s.outputPath.isEmpty()) { if (!file.open(stdout, QIODevice::WriteOnly)) return 1; }
+    else
+    {
+        file.setFileName(s.outputPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            ErrStream() << "Can't open " << s.outputPath << ": " << file.errorString() << '\n';
+            return 1;
+        }
+    }
+    QTextStream out(&file);
+    if (s.format == BenchmarkSettings::Format::CSV) WriteCSV (out, s, results);
+    else                                            WriteJSON(out, s, results, renderer);
+    return 0;
+}
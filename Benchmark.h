@@ -0,0 +1,18 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+class QCommandLineParser;
+
+// Headless mode: renders the demo scene (or that of --stress-scene or --scene-file)
+// offscreen N frames per render strategy and reports wall-clock and GPU frame time
+// statistics as CSV or JSON
+
+extern bool BenchmarkRequested(int argc, char * argv[]); // may be called before QApplication
+extern void PrepareHeadlessPlatform(); // call before QApplication is constructed
+extern void AddBenchmarkOptions(QCommandLineParser & parser);
+extern int RunBenchmark(const QCommandLineParser & parser); // returns process exit code
+
+#endif // BENCHMARK_H
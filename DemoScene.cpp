@@ -0,0 +1,104 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "DemoScene.h"
+
+#include "GlassWall.h"
+
+#include <array>
+
+static std::array<GlassWall *, 3> g_animatedWalls; // rather than FindInstance() every frame
+
+static QMatrix3x3 Affine(QMatrix2x2 mat)
+{
+    float data [] = { mat(0, 0), mat(0, 1), 0,
+                      mat(1, 0), mat(1, 1), 0,
+                          0    ,     0    , 1  };
+    return QMatrix3x3(data);
+}
+
+void InitDemoWalls()
+{
+    {
+        static constexpr QVector2D a{-0.1f, -0.6f}, b{0.1f, -0.6f}, c{0.0f, -0.9f};
+        static constexpr QVector2D d{-0.1f, -0.9f}, e{0.1f, -0.9f}, f{0.0f, -0.6f};
+        QColor clrs [] = { QColor(255, 0, 0), QColor(255, 130, 0), QColor(255, 220, 0),
+                           QColor(0, 255, 0), QColor(0, 200, 255), QColor(0, 50, 255),
+                           QColor(120, 0, 255), QColor(220, 0, 200)                     };
+
+        static constexpr uint8_t count = 8;
+        static const float angleStep = 2 * g_pi_f / count;
+        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
+                                          -std::sin(angleStep), std::cos(angleStep)  };
+        static const QMatrix2x2 rot(rotdata);
+        QMatrix2x2 rot_t{};
+
+        auto & wall1 = GlassWall::MakeInstance(0, 0.5f, true, true);
+        auto & wall2 = GlassWall::MakeInstance(1, 0.5f, true, true);
+        g_animatedWalls[0] = &wall1; g_animatedWalls[1] = &wall2;
+        auto shape1 = wall1.AddShape({ a, b, c }), shape2 = wall2.AddShape({ d, e, f });
+        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
+        {
+            wall1.AddShapeInstance(shape1, Affine(rot_t), Qt::white, clrs[i]);
+            wall2.AddShapeInstance(shape2, Affine(rot_t), Qt::white, clrs[i]);
+        }
+    }
+    {
+        static constexpr QVector2D a{-0.9f, -0.04f}, b{-0.9f, 0.04f}, c{0.0f, 0.0f};
+        QColor clrs [] = { QColor(10, 100, 35), QColor(10, 30, 100), QColor(110, 30, 0),
+                           QColor(10, 35, 100), QColor(100, 5, 40), QColor(0, 70, 70),
+                           QColor(30, 100, 15), QColor(100, 0, 0) };
+
+
+
+        static constexpr uint8_t count = 8;
+        static const float angleStep = 2 * g_pi_f / count;
+        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
+                                          -std::sin(angleStep), std::cos(angleStep)  };
+        static const QMatrix2x2 rot(rotdata);
+        QMatrix2x2 rot_t{};
+
+        auto & wall1 = GlassWall::MakeInstance(2, 0.5f, true, true);
+        g_animatedWalls[2] = &wall1;
+        auto shape = wall1.AddShape({ a, b, c });
+        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
+            wall1.AddShapeInstance(shape, Affine(rot_t), Qt::yellow, clrs[i]);
+    }
+    {
+        static constexpr QVector2D a{-1.0f, 0.0f}, b{0.0f, 0.0f}, c{0.0f, 1.0f};
+        QColor clrs [] = { QColor(255, 255, 255), QColor(0, 255, 255),
+                           QColor(127, 127, 127), QColor(35, 35, 100)  };
+
+
+        static constexpr uint8_t count = 4;
+        static const float angleStep = 2 * g_pi_f / count;
+        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
+                                          -std::sin(angleStep), std::cos(angleStep)  };
+        static const QMatrix2x2 rot(rotdata);
+        QMatrix2x2 rot_t{};
+
+        auto & wall1 = GlassWall::MakeInstance(3, 0.5f, true, true);
+        auto shape = wall1.AddShape({ a, b, c });
+        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
+            wall1.AddShapeInstance(shape, Affine(rot_t), clrs[i], clrs[i]);
+    }
+}
+
+void UpdateDemoWalls(float p)
+{
+    float angle = 2 * g_pi_f * p;
+    auto cos  = std::cos(angle    ), sin  = std::sin(angle    );
+    auto cos2 = std::cos(angle / 2), sin2 = std::sin(angle / 2);
+    float trData1 [] = {  cos ,  sin , 0,
+                         -sin ,  cos , 0,
+                            0 ,    0 , 1  };
+    float trData2 [] = {  cos , -sin , 0,
+                          sin ,  cos , 0,
+                            0 ,    0 , 1  };
+    float trData3 [] = {  cos2, -sin2, 0,
+                          sin2,  cos2, 0,
+                            0 ,    0 , 1  };
+    g_animatedWalls[0]->Transformation(QMatrix3x3(trData1));
+    g_animatedWalls[1]->Transformation(QMatrix3x3(trData2));
+    g_animatedWalls[2]->Transformation(QMatrix3x3(trData3));
+}
@@ -0,0 +1,12 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef DEMOSCENE_H
+#define DEMOSCENE_H
+
+// The glass walls shown by MainWindow and used by the benchmark
+
+extern void InitDemoWalls();
+extern void UpdateDemoWalls(float p); // p in [0, 1] is the animation phase
+
+#endif // DEMOSCENE_H
@@ -0,0 +1,483 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "ErrorAnalyzer.h"
+
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QImage>
+
+#include <array>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+#include "SceneSnapshot.h"
+#include "SceneRenderer.h"
+#include "DemoScene.h"
+#include "Parallel.h"
+
+struct AnalyzerSettings
+{
+    int width = 512, height = 512;
+    float phase = 0;             // of the demo scene animation
+    int scenes = 0;              // 0: analyze the demo scene; otherwise random scenes
+    unsigned seed = 1;
+    int maxWalls = 8, maxTrianglesPerWall = 8;
+    float minOpacity = 0.05f, maxOpacity = 0.95f;
+    float threshold = 4;         // acceptable error, in 8-bit display levels
+    unsigned threads = 0;
+    QString imagesPrefix;        // demo scene only
+    QString outputPath;          // stdout if empty
+};
+
+struct Color { float r = 0, g = 0, b = 0; };
+
+static Color ToColor(RGB16 c)
+{
+    constexpr float k = 1.0f / std::numeric_limits<uint16_t>::max();
+    return { c.r * k, c.g * k, c.b * k };
+}
+
+static float ToDisplayLevel(float linear) // inverse of SRGB_to_Linear, in [0, 255]
+{ return std::pow(std::clamp(linear, 0.0f, 1.0f), 1 / 2.2f) * 255; }
+
+static float Error(const Color & a, const Color & b)
+{
+    return std::max({ std::abs(ToDisplayLevel(a.r) - ToDisplayLevel(b.r)),
+                      std::abs(ToDisplayLevel(a.g) - ToDisplayLevel(b.g)),
+                      std::abs(ToDisplayLevel(a.b) - ToDisplayLevel(b.b))  });
+}
+
+
+
+// Triangles in normalized device coordinates, as gl_Position.xy of the geometry shader
+struct ProjectedTriangle
+{
+    QVector2D v[3];
+    float minX, maxX, minY, maxY;
+    Color fill;
+
+    bool Covers(float x, float y) const
+    {
+        if (x < minX || x > maxX || y < minY || y > maxY) return false;
+        float e[3];
+        for (int i = 0; i != 3; ++i)
+        {
+            auto & p = v[i]; auto & q = v[(i + 1) % 3];
+            e[i] = (q.x() - p.x()) * (y - p.y()) - (q.y() - p.y()) * (x - p.x());
+        }
+        return (e[0] >= 0 && e[1] >= 0 && e[2] >= 0) || (e[0] <= 0 && e[1] <= 0 && e[2] <= 0);
+    }
+};
+
+struct ProjectedWall
+{
+    float depth, opacity;
+    bool transparent;
+    std::vector<ProjectedTriangle> triangles;
+};
+
+using ProjectedScene = std::vector<ProjectedWall>; // from far to near
+
+static ProjectedScene Project(const SceneSnapshot & snapshot, const QMatrix3x3 & projMat)
+{
+    ProjectedScene ret;
+    ret.reserve(snapshot.walls.size());
+    for (auto & wall : snapshot.walls)
+    {
+        auto & pw = ret.emplace_back(ProjectedWall{ wall.depth, wall.opacity,
+                                                    wall.transparent, {} });
+        auto m = projMat * wall.transformation;
+        auto apply = [&m](QVector2D p)
+        { return QVector2D( m(0, 0) * p.x() + m(0, 1) * p.y() + m(0, 2),
+                            m(1, 0) * p.x() + m(1, 1) * p.y() + m(1, 2) ); };
+        pw.triangles.reserve(wall.triangles.size());
+        for (auto & t : wall.triangles)
+        {
+            ProjectedTriangle pt{ { apply(t.a), apply(t.b), apply(t.c) }, 0, 0, 0, 0,
+                                  ToColor(t.fillColor) };
+            pt.minX = std::min({ pt.v[0].x(), pt.v[1].x(), pt.v[2].x() });
+            pt.maxX = std::max({ pt.v[0].x(), pt.v[1].x(), pt.v[2].x() });
+            pt.minY = std::min({ pt.v[0].y(), pt.v[1].y(), pt.v[2].y() });
+            pt.maxY = std::max({ pt.v[0].y(), pt.v[1].y(), pt.v[2].y() });
+            pw.triangles.push_back(pt);
+        }
+    }
+    return ret;
+}
+
+struct SampleResult
+{
+    Color exact, wboit;
+    int layers = 0;         // transparent fragments that passed the depth test
+    float meanOpacity = 0;
+};
+
+// Mirrors what the GPU does: the opaque pass with LEQUAL depth test, then either
+// blending in drawing order (exact, as CODB) or the WBOIT accumulation and composite
+// (as ApplyTTexturesGLResources). Edges are one pixel wide lines and aren't modeled.
+static SampleResult Sample(const ProjectedScene & scene, float x, float y)
+{
+    float opaqueDepth = 1; Color opaque;
+    for (auto & wall : scene)
+    {
+        if (wall.transparent || wall.depth > opaqueDepth) continue;
+        for (auto & t : wall.triangles)
+            if (t.Covers(x, y)) { opaqueDepth = wall.depth; opaque = t.fill; }
+    }
+
+    SampleResult ret;
+    ret.exact = opaque;
+    Color sumOfColors; float sumOfWeights = 0, revealage = 1, sumOfOpacities = 0;
+    for (auto & wall : scene)
+    {
+        if (!wall.transparent || wall.depth > opaqueDepth) continue;
+        float w = wall.opacity;
+        for (auto & t : wall.triangles)
+        {
+            if (!t.Covers(x, y)) continue;
+            ret.exact.r = ret.exact.r * (1 - w) + t.fill.r * w;
+            ret.exact.g = ret.exact.g * (1 - w) + t.fill.g * w;
+            ret.exact.b = ret.exact.b * (1 - w) + t.fill.b * w;
+            sumOfColors.r += w * t.fill.r;
+            sumOfColors.g += w * t.fill.g;
+            sumOfColors.b += w * t.fill.b;
+            sumOfWeights += w; revealage *= 1 - w;
+            sumOfOpacities += w; ++ret.layers;
+        }
+    }
+
+    if (sumOfWeights == 0) ret.wboit = opaque;
+    else
+    {
+        float alpha = 1 - revealage;
+        ret.wboit.r = sumOfColors.r / sumOfWeights * alpha + opaque.r * (1 - alpha);
+        ret.wboit.g = sumOfColors.g / sumOfWeights * alpha + opaque.g * (1 - alpha);
+        ret.wboit.b = sumOfColors.b / sumOfWeights * alpha + opaque.b * (1 - alpha);
+    }
+    if (ret.layers != 0) ret.meanOpacity = sumOfOpacities / ret.layers;
+    return ret;
+}
+
+
+
+struct ErrorAccumulator
+{
+    static constexpr int binsPerLevel = 4, bins = 256 * binsPerLevel;
+
+    uint64_t count = 0, overThreshold = 0;
+    double sum = 0, sumSq = 0;
+    float max = 0;
+    std::array<uint32_t, bins> histogram{};
+
+    void Add(float err, float threshold)
+    {
+        ++count; sum += err; sumSq += static_cast<double>(err) * err;
+        max = std::max(max, err);
+        if (err > threshold) ++overThreshold;
+        ++histogram[std::min(static_cast<int>(err * binsPerLevel), bins - 1)];
+    }
+    void Merge(const ErrorAccumulator & o)
+    {
+        count += o.count; overThreshold += o.overThreshold;
+        sum += o.sum; sumSq += o.sumSq; max = std::max(max, o.max);
+        for (int i = 0; i != bins; ++i) histogram[i] += o.histogram[i];
+    }
+    double Mean() const { return count ? sum / count : 0; }
+    double RMS () const { return count ? std::sqrt(sumSq / count) : 0; }
+    double OverThresholdFraction() const
+    { return count ? static_cast<double>(overThreshold) / count : 0; }
+    float Percentile(double p) const // upper bound of the bin
+    {
+        auto rank = static_cast<uint64_t>(std::ceil(p * count));
+        uint64_t acc = 0;
+        for (int i = 0; i != bins; ++i)
+            if ((acc += histogram[i]) >= rank && acc != 0)
+                return std::min(static_cast<float>(i + 1) / binsPerLevel, max);
+        return max;
+    }
+};
+
+// Error of samples covered by at least one transparent fragment,
+// grouped by count of transparent layers and their mean opacity
+struct ErrorTable
+{
+    static constexpr int layerGroups = 16, opacityGroups = 10; // the last layer group is "16+"
+    ErrorAccumulator total;
+    std::array<std::array<ErrorAccumulator, opacityGroups>, layerGroups> groups{};
+
+    void Add(const SampleResult & r, float err, float threshold)
+    {
+        if (r.layers == 0) return;
+        total.Add(err, threshold);
+        auto lg = std::min(r.layers, layerGroups) - 1;
+        auto og = std::clamp(static_cast<int>(r.meanOpacity * opacityGroups), 0, opacityGroups - 1);
+        groups[static_cast<size_t>(lg)][static_cast<size_t>(og)].Add(err, threshold);
+    }
+    void Merge(const ErrorTable & o)
+    {
+        total.Merge(o.total);
+        for (size_t l = 0; l != layerGroups; ++l)
+            for (size_t o_ = 0; o_ != opacityGroups; ++o_) groups[l][o_].Merge(o.groups[l][o_]);
+    }
+};
+
+
+
+static SceneSnapshot RandomScene(std::mt19937 & rng, const AnalyzerSettings & s)
+{
+    std::uniform_int_distribution<int> wallCount(1, s.maxWalls);
+    std::uniform_int_distribution<int> triangleCount(1, s.maxTrianglesPerWall);
+    std::uniform_real_distribution<float> coord(-1, 1);
+    std::uniform_real_distribution<float> opacity(s.minOpacity, s.maxOpacity);
+    std::uniform_int_distribution<int> channel(0, std::numeric_limits<uint16_t>::max());
+    std::bernoulli_distribution opaqueWall(0.1);
+    auto randomColor = [&]
+    { return RGB16( static_cast<uint16_t>(channel(rng)), static_cast<uint16_t>(channel(rng)),
+                    static_cast<uint16_t>(channel(rng))                                      ); };
+
+    SceneSnapshot ret;
+    auto walls = wallCount(rng);
+    for (int i = 0; i != walls; ++i)
+    {
+        auto & wall = ret.walls.emplace_back(SceneSnapshot::Wall{
+            walls == 1 ? 0.5f : 1 - static_cast<float>(i) / (walls - 1), // far to near
+            opacity(rng), !opaqueWall(rng), QMatrix3x3(), {}                          });
+        auto triangles = triangleCount(rng);
+        for (int t = 0; t != triangles; ++t)
+        {
+            QVector2D a(coord(rng), coord(rng)), b(coord(rng), coord(rng)),
+                      c(coord(rng), coord(rng));
+            auto color = randomColor();
+            wall.triangles.push_back({ a, b, c, color, color });
+        }
+    }
+    return ret;
+}
+
+static QTextStream & ErrStream() { static QTextStream s(stderr); return s; }
+
+static bool ParseInt(const QString & str, int min, int & out)
+{
+    bool ok = false;
+    int v = str.toInt(&ok);
+    if (!ok || v < min) return false;
+    out = v;
+    return true;
+}
+
+// Returns an error message or an empty string on success
+static QString ParseAnalyzerSettings(const QCommandLineParser & parser, AnalyzerSettings & s)
+{
+    auto size = parser.value(QStringLiteral("analyze-size")).toLower().split('x');
+    if (   size.size() != 2 || !ParseInt(size[0], 1, s.width )
+                            || !ParseInt(size[1], 1, s.height) )
+        return QStringLiteral("--analyze-size must look like 512x512");
+
+    bool ok = false;
+    s.phase = parser.value(QStringLiteral("analyze-phase")).toFloat(&ok);
+    if (!ok || s.phase < 0 || s.phase > 1)
+        return QStringLiteral("--analyze-phase must be in [0, 1]");
+
+    if (!ParseInt(parser.value(QStringLiteral("analyze-scenes")), 0, s.scenes))
+        return QStringLiteral("--analyze-scenes must be a non-negative integer");
+    s.seed = parser.value(QStringLiteral("analyze-seed")).toUInt(&ok);
+    if (!ok) return QStringLiteral("--analyze-seed must be a non-negative integer");
+    if (!ParseInt(parser.value(QStringLiteral("analyze-max-walls")), 1, s.maxWalls))
+        return QStringLiteral("--analyze-max-walls must be a positive integer");
+    if (!ParseInt(parser.value(QStringLiteral("analyze-max-triangles")), 1,
+                  s.maxTrianglesPerWall))
+        return QStringLiteral("--analyze-max-triangles must be a positive integer");
+
+    auto range = parser.value(QStringLiteral("analyze-opacity")).split(',');
+    bool ok2 = false;
+    if (range.size() == 2)
+    { s.minOpacity = range[0].toFloat(&ok); s.maxOpacity = range[1].toFloat(&ok2); }
+    if (!ok || !ok2 || s.minOpacity < 0 || s.maxOpacity > 1 || s.minOpacity > s.maxOpacity)
+        return QStringLiteral("--analyze-opacity must look like 0.05,0.95");
+
+    s.threshold = parser.value(QStringLiteral("analyze-threshold")).toFloat(&ok);
+    if (!ok || s.threshold < 0)
+        return QStringLiteral("--analyze-threshold must be a non-negative number");
+    int threads = 0;
+    if (!ParseInt(parser.value(QStringLiteral("analyze-threads")), 0, threads))
+        return QStringLiteral("--analyze-threads must be a non-negative integer");
+    s.threads = static_cast<unsigned>(threads);
+
+    s.imagesPrefix = parser.value(QStringLiteral("analyze-images"));
+    s.outputPath   = parser.value(QStringLiteral("analyze-output"));
+    return {};
+}
+
+bool ErrorAnalysisRequested(int argc, char * argv[])
+{
+    for (int i = 1; i < argc; ++i) if (std::strcmp(argv[i], "--analyze") == 0) return true;
+    return false;
+}
+
+void AddErrorAnalyzerOptions(QCommandLineParser & parser)
+{
+    parser.addOption({ QStringLiteral("analyze"),
+                       QStringLiteral("Compare WBOIT with exact sorted blending on the CPU "
+                                      "and report the error instead of showing the window.") });
+    parser.addOption({ QStringLiteral("analyze-size"),
+                       QStringLiteral("Sample grid size, one sample per pixel centre."),
+                       QStringLiteral("WxH"), QStringLiteral("512x512") });
+    parser.addOption({ QStringLiteral("analyze-phase"),
+                       QStringLiteral("Animation phase of the demo scene, in [0, 1]."),
+                       QStringLiteral("p"), QStringLiteral("0") });
+    parser.addOption({ QStringLiteral("analyze-scenes"),
+                       QStringLiteral("Analyze this many random scenes instead of the demo one."),
+                       QStringLiteral("n"), QStringLiteral("0") });
+    parser.addOption({ QStringLiteral("analyze-seed"),
+                       QStringLiteral("Seed of the random scenes."),
+                       QStringLiteral("n"), QStringLiteral("1") });
+    parser.addOption({ QStringLiteral("analyze-max-walls"),
+                       QStringLiteral("Maximum count of walls in a random scene."),
+                       QStringLiteral("n"), QStringLiteral("8") });
+    parser.addOption({ QStringLiteral("analyze-max-triangles"),
+                       QStringLiteral("Maximum count of triangles per wall in a random scene."),
+                       QStringLiteral("n"), QStringLiteral("8") });
+    parser.addOption({ QStringLiteral("analyze-opacity"),
+                       QStringLiteral("Opacity range of walls in random scenes."),
+                       QStringLiteral("min,max"), QStringLiteral("0.05,0.95") });
+    parser.addOption({ QStringLiteral("analyze-threshold"),
+                       QStringLiteral("Acceptable error in 8-bit display levels."),
+                       QStringLiteral("levels"), QStringLiteral("4") });
+    parser.addOption({ QStringLiteral("analyze-threads"),
+                       QStringLiteral("Worker threads (0: all cores)."),
+                       QStringLiteral("n"), QStringLiteral("0") });
+    parser.addOption({ QStringLiteral("analyze-images"),
+                       QStringLiteral("Write <prefix>_exact.png, <prefix>_wboit.png and "
+                                      "<prefix>_error.png for the demo scene."),
+                       QStringLiteral("prefix") });
+    parser.addOption({ QStringLiteral("analyze-output"),
+                       QStringLiteral("Output CSV file (default: stdout)."),
+                       QStringLiteral("file") });
+}
+
+static QRgb ToDisplayRgb(const Color & c)
+{
+    return qRgb( qRound(ToDisplayLevel(c.r)), qRound(ToDisplayLevel(c.g)),
+                 qRound(ToDisplayLevel(c.b))                               );
+}
+
+static void WriteTable(QTextStream & out, const ErrorTable & table)
+{
+    out << "layers,opacity_from,opacity_to,samples,mean_err,rms_err,p99_err,max_err,"
+           "over_threshold_fraction\n";
+    for (int l = 0; l != ErrorTable::layerGroups; ++l)
+        for (int o = 0; o != ErrorTable::opacityGroups; ++o)
+        {
+            auto & acc = table.groups[static_cast<size_t>(l)][static_cast<size_t>(o)];
+            if (acc.count == 0) continue;
+            out << (l + 1 == ErrorTable::layerGroups ? QString::number(l + 1) + '+'
+                                                     : QString::number(l + 1)       ) << ','
+                << static_cast<double>(o    ) / ErrorTable::opacityGroups << ','
+                << static_cast<double>(o + 1) / ErrorTable::opacityGroups << ','
+                << acc.count << ',' << acc.Mean() << ',' << acc.RMS() << ','
+                << acc.Percentile(0.99) << ',' << acc.max << ','
+                << acc.OverThresholdFraction() << '\n';
+        }
+}
+
+int RunErrorAnalysis(const QCommandLineParser & parser)
+{
+    AnalyzerSettings s;
+    auto error = ParseAnalyzerSettings(parser, s);
+    if (!error.isEmpty()) { ErrStream() << error << '\n'; return 1; }
+
+    auto projMat = SceneRenderer::ProjectionMatrix(s.width, s.height);
+    std::vector<ProjectedScene> scenes;
+    if (s.scenes == 0)
+    {
+        InitDemoWalls();
+        UpdateDemoWalls(s.phase);
+        scenes.push_back(Project(SceneSnapshot::FromGlassWalls(), projMat));
+    }
+    else
+    {
+        scenes.reserve(static_cast<size_t>(s.scenes));
+        for (int i = 0; i != s.scenes; ++i)
+        {
+            std::mt19937 rng(s.seed + static_cast<unsigned>(i)); // independent of thread count
+            scenes.push_back(Project(RandomScene(rng, s), projMat));
+        }
+    }
+
+    const bool writeImages = s.scenes == 0 && !s.imagesPrefix.isEmpty();
+    const auto pixels = writeImages ? static_cast<size_t>(s.width) * s.height : 0;
+    std::vector<QRgb> exactPixels(pixels), wboitPixels(pixels); // bottom row first, as in GL
+    std::vector<uchar> errorPixels(pixels);
+
+    auto workers = WorkerCount(s.threads);
+    std::vector<ErrorTable> tables(workers); // one per worker, merged afterwards
+    const auto rows = static_cast<size_t>(s.height);
+    ParallelFor(scenes.size() * rows, workers, [&](size_t i, unsigned worker)
+    {
+        auto & scene = scenes[i / rows];
+        auto row = static_cast<int>(i % rows);
+        auto & table = tables[worker];
+        float y = (row + 0.5f) / s.height * 2 - 1;
+        for (int col = 0; col != s.width; ++col)
+        {
+            float x = (col + 0.5f) / s.width * 2 - 1;
+            auto r = Sample(scene, x, y);
+            auto err = Error(r.exact, r.wboit);
+            table.Add(r, err, s.threshold);
+            if (!writeImages) continue;
+            auto p = static_cast<size_t>(row) * s.width + col;
+            exactPixels[p] = ToDisplayRgb(r.exact);
+            wboitPixels[p] = ToDisplayRgb(r.wboit);
+            // the threshold maps to mid-grey
+            errorPixels[p] = static_cast<uchar>(
+                std::min(255.0f, s.threshold > 0 ? err / s.threshold * 128 : err * 255) );
+        }
+    });
+
+    ErrorTable table;
+    for (auto & t : tables) table.Merge(t);
+
+    ErrStream() << "Samples with transparency: " << table.total.count
+                << ", mean error: " << table.total.Mean()
+                << ", p99: " << table.total.Percentile(0.99)
+                << ", max: " << table.total.max
+                << ", over threshold: " << table.total.OverThresholdFraction() * 100 << "%\n";
+
+    if (writeImages)
+    {
+        QImage exactImage(s.width, s.height, QImage::Format_RGB32),
+               wboitImage(s.width, s.height, QImage::Format_RGB32),
+               errorImage(s.width, s.height, QImage::Format_Grayscale8);
+        for (int row = 0; row != s.height; ++row)
+        {
+            auto p = static_cast<size_t>(s.height - 1 - row) * s.width;
+            std::copy_n(&exactPixels[p], s.width, reinterpret_cast<QRgb *>(exactImage.scanLine(row)));
+            std::copy_n(&wboitPixels[p], s.width, reinterpret_cast<QRgb *>(wboitImage.scanLine(row)));
+            std::copy_n(&errorPixels[p], s.width, errorImage.scanLine(row));
+        }
+        if (   !exactImage.save(s.imagesPrefix + QStringLiteral("_exact.png"))
+            || !wboitImage.save(s.imagesPrefix + QStringLiteral("_wboit.png"))
+            || !errorImage.save(s.imagesPrefix + QStringLiteral("_error.png")) )
+        { ErrStream() << "Can't write images with prefix " << s.imagesPrefix << '\n'; return 1; }
+    }
+
+    QFile file;
+    if (s.outputPath.isEmpty()) { if (!file.open(stdout, QIODevice::WriteOnly)) return 1; }
+    else
+    {
+        file.setFileName(s.outputPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            ErrStream() << "Can't open " << s.outputPath << ": " << file.errorString() << '\n';
+            return 1;
+        }
+    }
+    QTextStream out(&file);
+    WriteTable(out, table);
+    return 0;
+}
@@ -0,0 +1,17 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef ERRORANALYZER_H
+#define ERRORANALYZER_H
+
+class QCommandLineParser;
+
+// CPU tool comparing WBOIT with exact back-to-front compositing at pixel centres,
+// either for the demo scene or for a sweep of random scenes. Reports the error
+// grouped by the number of transparent layers and their mean opacity.
+
+extern bool ErrorAnalysisRequested(int argc, char * argv[]); // may be called before QApplication
+extern void AddErrorAnalyzerOptions(QCommandLineParser & parser);
+extern int RunErrorAnalysis(const QCommandLineParser & parser); // returns process exit code
+
+#endif // ERRORANALYZER_H
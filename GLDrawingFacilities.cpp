@@ -3,76 +3,421 @@
 
 #include "GLDrawingFacilities.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
 
-#include "GLWidget.h"
+#include <QOpenGLContext>
+#include <QCoreApplication>
 
 const double g_pi = 3.1415926535897932384626433832795;
 const float g_pi_f = static_cast<const float>(g_pi);
 
-struct VAO_Holder::Impl
+OpenGLFunctions * GLFunctions()
+{ return QOpenGLContext::currentContext()->versionFunctions<OpenGLFunctions>(); }
+
+void EnableGLContextSharing() { QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts); }
+
+bool SharesGLObjects(QOpenGLContext * context)
+{
+    auto global = QOpenGLContext::globalShareContext();
+    return global && QOpenGLContext::areSharing(context, global);
+}
+
+bool HasVertexShaderStorageBlocks()
+{
+    GLint blocks = 0;
+    GLFunctions()->glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &blocks);
+    return blocks > 0;
+}
+
+std::vector<GLContextOwner *> g_GLContextOwners;
+
+struct SlotInfo
 {
-    std::unordered_map<
-            QOpenGLContext *,    // Context where the VAO is generated
-            std::pair< GLuint,   // VAO name
-                       bool    > // true: VAO's settings are fresh; just bind
-                                 //       it and draw without tweaking anything
-                                 // false: need to call some glVertexAttribPointer or whatever
-                     > wgt_vao_map;
+    GLContextOwner * owner = nullptr; // nullptr if free
+    QOpenGLContext * context = nullptr; // of the owner in this generation, once seen
+    uint32_t generation = 0;
+    std::vector<GLuint> deletedVAOs;
 };
+static std::vector<SlotInfo> g_slots;
+static QOpenGLContext * g_lastContext = nullptr; // cache of CurrentGLContextSlot()
+static uint32_t g_lastSlot = 0;
+
+void RegisterGLContextOwner(GLContextOwner * owner)
+{
+    assert(std::find(g_GLContextOwners.begin(), g_GLContextOwners.end(), owner)
+           == g_GLContextOwners.end());
+    g_GLContextOwners.push_back(owner);
+
+    auto it = std::find_if( g_slots.begin(), g_slots.end(),
+                            [](const SlotInfo & s) { return !s.owner; } );
+    if (it == g_slots.end()) it = g_slots.emplace(g_slots.end());
+    it->owner = owner;
+    ++it->generation;
+
+    emit GLContextSignalEmitter::Instance().ComingToLife(owner);
+}
+
+void UnregisterGLContextOwner(GLContextOwner * owner)
+{
+    auto it_owner = std::find(g_GLContextOwners.begin(), g_GLContextOwners.end(), owner);
+    assert(it_owner != g_GLContextOwners.end());
+    g_GLContextOwners.erase(it_owner);
+
+    auto it = std::find_if( g_slots.begin(), g_slots.end(),
+                            [owner](const SlotInfo & s) { return s.owner == owner; } );
+    assert(it != g_slots.end());
+    it->owner = nullptr; it->context = nullptr;
+    it->deletedVAOs.clear(); // they die with the context
+    g_lastContext = nullptr;
+
+    emit GLContextSignalEmitter::Instance().GoingToDie(owner);
+}
+
+GLContextSlot CurrentGLContextSlot()
+{
+    auto current = QOpenGLContext::currentContext();
+    assert(current);
+    if (current != g_lastContext)
+    {
+        // Contexts of owners may be recreated, so they are looked up, not remembered
+        auto it = std::find_if( g_slots.begin(), g_slots.end(), [current](const SlotInfo & s)
+                                { return s.owner && s.owner->GLContext() == current; } );
+        assert(it != g_slots.end());
+        auto index = static_cast<uint32_t>(it - g_slots.begin());
+        if (it->context != current)
+        {
+            // The owner recreated its context: entries of the old one are stale
+            if (it->context) { ++it->generation; it->deletedVAOs.clear(); }
+            it->context = current;
+            QObject::connect( current, &QOpenGLContext::aboutToBeDestroyed, [current, index]
+            {
+                // Before the next context of the owner may get the same address
+                auto & s = g_slots[index];
+                if (s.context == current)
+                { s.context = nullptr; ++s.generation; s.deletedVAOs.clear(); }
+                if (g_lastContext == current) g_lastContext = nullptr;
+            });
+        }
+        g_lastContext = current;
+        g_lastSlot = index;
+    }
+    return { g_lastSlot, g_slots[g_lastSlot].generation };
+}
+
+bool IsAlive(GLContextSlot slot)
+{
+    return    slot.index < g_slots.size() && g_slots[slot.index].owner
+           && g_slots[slot.index].generation == slot.generation;
+}
+
+GLContextSignalEmitter & GLContextSignalEmitter::Instance()
+{
+    static GLContextSignalEmitter t;
+    return t;
+}
+
+void FlushDeletedVAOs()
+{
+    auto & deleted = g_slots[CurrentGLContextSlot().index].deletedVAOs;
+    if (deleted.empty()) return;
+    GLFunctions()->glDeleteVertexArrays(static_cast<GLsizei>(deleted.size()), deleted.data());
+    deleted.clear();
+}
 
-VAO_Holder::VAO_Holder() : impl(std::make_unique<Impl>())
+struct GLProgramTables
 {
-    for (auto wgt : g_GLWidgets)
-        impl->wgt_vao_map.emplace(wgt->context(), std::pair{ wgt->GenVAO(), false });
+    using Key = std::pair<const void *, uint32_t>;
+    struct Owned { void * program; void (*release)(void *); };
+    struct Context // by slot index
+    {
+        GLContextOwner * owner = nullptr; // nullptr if the table is unused
+        uint32_t generation = 0;
+        QOpenGLContextGroup * group = nullptr;
+        std::map<Key, void *> programs;
+    };
+
+    std::map<QOpenGLContextGroup *, std::map<Key, Owned>> groups;
+    std::vector<Context> contexts;
+
+    explicit GLProgramTables()
+    {
+        QObject::connect( &GLContextSignalEmitter::Instance(), &GLContextSignalEmitter::GoingToDie,
+                          [this](GLContextOwner * owner) { Release(owner); }                    );
+    }
+    ~GLProgramTables() { for (auto & g : groups) ReleaseAll(g.second); }
+    GLProgramTables(const GLProgramTables & ) = delete;
+    GLProgramTables(      GLProgramTables &&) = delete;
+    GLProgramTables & operator=(const GLProgramTables & ) = delete;
+    GLProgramTables & operator=(      GLProgramTables &&) = delete;
+
+    Context & Current()
+    {
+        auto slot = CurrentGLContextSlot();
+        if (slot.index >= contexts.size()) contexts.resize(slot.index + 1);
+        auto & c = contexts[slot.index];
+        if (!c.owner || c.generation != slot.generation)
+        {
+            c.owner = g_slots[slot.index].owner; c.generation = slot.generation;
+            c.group = QOpenGLContext::currentContext()->shareGroup();
+            c.programs.clear();
+        }
+        return c;
+    }
 
-    connect(&GLWidgetSignalEmitter::Instance(), &GLWidgetSignalEmitter::GoingToDie,
-            this, [this](GLWidget * sender)
+    // Owners unregister with their context current, so objects are deleted in it;
+    // were no context of the group current, they would be left to the share group
+    static void ReleaseAll(std::map<Key, Owned> & programs)
     {
-        auto it = impl->wgt_vao_map.find(sender->context());
-        assert(it != impl->wgt_vao_map.end());
-        impl->wgt_vao_map.erase(it);
-    });
-    connect(&GLWidgetSignalEmitter::Instance(), &GLWidgetSignalEmitter::ComingToLife,
-            this, [this](GLWidget * sender)
+        for (auto & p : programs) p.second.release(p.second.program);
+        programs.clear();
+    }
+
+    void Release(GLContextOwner * owner)
     {
-        assert(impl->wgt_vao_map.find(sender->context()) == impl->wgt_vao_map.end());
-        impl->wgt_vao_map.emplace(sender->context(), std::pair{ sender->GenVAO(), false });
-    });
+        auto it = std::find_if( contexts.begin(), contexts.end(),
+                                [owner](const Context & c) { return c.owner == owner; } );
+        if (it == contexts.end()) return; // never used programs
+        auto group = it->group;
+        *it = Context();
+        for (uint32_t i = 0; i != contexts.size(); ++i)
+            if (   contexts[i].owner && contexts[i].group == group
+                && IsAlive({ i, contexts[i].generation })          ) return;
+        auto it_group = groups.find(group);
+        if (it_group == groups.end()) return;
+        ReleaseAll(it_group->second);
+        groups.erase(it_group);
+    }
+};
+
+static GLProgramTables & ProgramTables() { static GLProgramTables t; return t; }
+
+void * FindGLProgram(GLProgramKey key)
+{
+    auto & tables = ProgramTables();
+    auto & c = tables.Current();
+    GLProgramTables::Key k{ key.type, key.variant };
+    auto it = c.programs.find(k);
+    if (it != c.programs.end()) return it->second;
+
+    auto it_group = tables.groups.find(c.group);
+    if (it_group == tables.groups.end()) return nullptr;
+    auto it_program = it_group->second.find(k);
+    if (it_program == it_group->second.end()) return nullptr;
+    return c.programs[k] = it_program->second.program;
 }
 
+void * AddGLProgram(GLProgramKey key, void * program, void (*release)(void *))
+{
+    auto & tables = ProgramTables();
+    auto & c = tables.Current();
+    GLProgramTables::Key k{ key.type, key.variant };
+    if (!tables.groups[c.group].emplace(k, GLProgramTables::Owned{ program, release }).second)
+        assert(false);
+    return c.programs[k] = program;
+}
+
+
+
+struct VAO_Holder::Impl
+{
+    struct Entry
+    {
+        GLuint vao = 0;
+        uint32_t generation = 0; // of the slot when the VAO was generated
+        bool ready = false;      // false: need to call some glVertexAttribPointer or whatever
+    };
+    std::vector<Entry> entries; // by context slot index
+
+    Entry & Current()
+    {
+        auto slot = CurrentGLContextSlot();
+        if (slot.index >= entries.size()) entries.resize(slot.index + 1);
+        auto & e = entries[slot.index];
+        if (!e.vao || e.generation != slot.generation)
+        {
+            GLFunctions()->glGenVertexArrays(1, &e.vao);
+            e.generation = slot.generation; e.ready = false;
+        }
+        return e;
+    }
+};
+
+VAO_Holder::VAO_Holder() : impl(std::make_unique<Impl>()) {}
+
 VAO_Holder::~VAO_Holder()
 {
-    for (auto wgt : g_GLWidgets)
+    for (uint32_t i = 0; i != impl->entries.size(); ++i)
     {
-        auto it = impl->wgt_vao_map.find(wgt->context());
-        assert(it != impl->wgt_vao_map.end());
-        if (!wgt->DeleteVAO(it->second.first)) assert(false);
+        auto & e = impl->entries[i];
+        if (e.vao && IsAlive({ i, e.generation })) g_slots[i].deletedVAOs.push_back(e.vao);
     }
 }
 
-std::pair<GLuint, bool> VAO_Holder::GetVAO() const
+std::pair<GLuint, bool> VAO_Holder::GetVAO()
 {
-    auto current = QOpenGLContext::currentContext();
-    auto it = impl->wgt_vao_map.find(current);
-    assert(it != impl->wgt_vao_map.end());
-    return { it->second.first, it->second.second };
+    auto & e = impl->Current();
+    return { e.vao, e.ready };
+}
+
+void VAO_Holder::VAO_SetReady() { impl->Current().ready = true; }
+
+void VAO_Holder::Invalidate() { for (auto & e : impl->entries) e.ready = false; }
+
+
+
+void SetupTriangleAttributes(OpenGLFunctions * f, GLuint binding, bool edgeColor)
+{
+    for (GLuint i = 0; i != 3; ++i)
+    {
+        f->glVertexAttribFormat(i, 2, GL_FLOAT, GL_FALSE, i * 2 * sizeof(GLfloat));
+        f->glVertexAttribBinding(i, binding);
+        f->glEnableVertexAttribArray(i);
+    }
+    f->glVertexAttribFormat( 3, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                             edgeColor ? offsetof(PackedTriangle, edgeColor)
+                                       : offsetof(PackedTriangle, fillColor) );
+    f->glVertexAttribBinding(3, binding);
+    f->glEnableVertexAttribArray(3);
 }
 
-void VAO_Holder::VAO_SetReady()
+void SetupInstanceAttributes(OpenGLFunctions * f, GLuint binding)
 {
-    auto current = QOpenGLContext::currentContext();
-    auto it = impl->wgt_vao_map.find(current);
-    assert(it != impl->wgt_vao_map.end());
-    it->second.second = true;
+    f->glVertexBindingDivisor(binding, 1);
+    auto attrib = [f, binding](GLuint index) { f->glVertexAttribBinding(index, binding);
+                                                f->glEnableVertexAttribArray(index);     };
+    f->glVertexAttribIFormat(4, 1, GL_UNSIGNED_INT, offsetof(PackedInstance, wall)); attrib(4);
+    f->glVertexAttribFormat(5, 3, GL_FLOAT, GL_FALSE, 0                  ); attrib(5);
+    f->glVertexAttribFormat(6, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat)); attrib(6);
+    f->glVertexAttribFormat( 7, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                             offsetof(PackedInstance, edgeColor) ); attrib(7);
+    f->glVertexAttribFormat( 8, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                             offsetof(PackedInstance, fillColor) ); attrib(8);
+    f->glVertexAttribIFormat(9, 1, GL_UNSIGNED_INT, offsetof(PackedInstance, ownColors)); attrib(9);
+}
+
+
+
+struct AppendOnlyBuffer::Impl
+{
+    size_t recordSize;
+    GLuint buffer = 0;
+    uint8_t * mapped = nullptr;
+    size_t capacity = 0, count = 0; // in records
+};
+
+AppendOnlyBuffer::AppendOnlyBuffer(size_t recordSize) : impl(std::make_unique<Impl>())
+{ impl->recordSize = recordSize; }
+
+AppendOnlyBuffer::~AppendOnlyBuffer()
+{ if (impl->buffer && QOpenGLContext::currentContext()) GLFunctions()->glDeleteBuffers(1, &impl->buffer); }
+
+bool AppendOnlyBuffer::Update(const void * data, size_t count)
+{
+    if (count == impl->count) return false;
+    assert(count > impl->count);
+    auto first = impl->count;
+    bool recreated = Append(count - first);
+
+    // The tail isn't used by any draw yet, so it is written without synchronization
+    std::memcpy( Records(first), static_cast<const uint8_t *>(data) + first * impl->recordSize,
+                 (count - first) * impl->recordSize                                           );
+    return recreated;
+}
+
+bool AppendOnlyBuffer::Append(size_t count)
+{
+    auto needed = impl->count + count;
+    bool recreated = false;
+    if (needed > impl->capacity)
+    {
+        auto f = GLFunctions();
+        static constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+                                                             | GL_MAP_COHERENT_BIT;
+        auto capacity = std::max<size_t>({ needed, impl->capacity * 2, 64 });
+        auto size = static_cast<GLsizeiptr>(capacity * impl->recordSize);
+        GLuint buffer;
+        f->glCreateBuffers(1, &buffer);
+        f->glNamedBufferStorage(buffer, size, nullptr, flags);
+        auto mapped = static_cast<uint8_t *>(f->glMapNamedBufferRange(buffer, 0, size, flags));
+        assert(mapped);
+        if (impl->buffer)
+        {
+            f->glCopyNamedBufferSubData( impl->buffer, buffer, 0, 0,
+                                         static_cast<GLsizeiptr>(impl->count * impl->recordSize) );
+            f->glUnmapNamedBuffer(impl->buffer);
+            f->glDeleteBuffers(1, &impl->buffer);
+        }
+        impl->buffer = buffer; impl->mapped = mapped; impl->capacity = capacity;
+        recreated = true;
+    }
+    impl->count = needed;
+    return recreated;
+}
+
+void * AppendOnlyBuffer::Records(size_t first) const
+{
+    assert(first <= impl->count);
+    return impl->mapped + first * impl->recordSize;
+}
+
+void AppendOnlyBuffer::Reset()
+{
+    if (impl->buffer)
+    {
+        auto f = GLFunctions();
+        f->glUnmapNamedBuffer(impl->buffer);
+        f->glDeleteBuffers(1, &impl->buffer);
+    }
+    impl->buffer = 0; impl->mapped = nullptr;
+    impl->capacity = impl->count = 0;
 }
 
+GLuint AppendOnlyBuffer::Buffer() const { return impl->buffer; }
+size_t AppendOnlyBuffer::Count() const { return impl->count; }
 
 
-RGB16 SRGB_to_Linear(QColor c)
+
+static uint16_t ToLinear(double c, SRGBCurve curve)
 {
     constexpr auto max = std::numeric_limits<uint16_t>::max();
-    return RGB16( static_cast<uint16_t>(std::pow(c.redF  (), 2.2) * max),
-                  static_cast<uint16_t>(std::pow(c.greenF(), 2.2) * max),
-                  static_cast<uint16_t>(std::pow(c.blueF (), 2.2) * max)  );
+    if (curve == SRGBCurve::Exact) return static_cast<uint16_t>(
+                ( c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4) ) * max );
+    return static_cast<uint16_t>(std::pow(c, 2.2) * max);
+}
+
+using SRGBTable = std::array<uint16_t, 256>;
+
+static const SRGBTable & Table(SRGBCurve curve)
+{
+    // QColor keeps 16-bit components, c * 257 for an 8-bit c
+    static const auto tables = [] {
+        std::array<SRGBTable, 2> t;
+        for (size_t k = 0; k != t.size(); ++k)
+            for (int c = 0; c != 256; ++c)
+                t[k][c] = ToLinear( c * 257 / qreal(std::numeric_limits<uint16_t>::max()),
+                                    static_cast<SRGBCurve>(k) );
+        return t;
+    }();
+    return tables[static_cast<size_t>(curve)];
 }
+
+static uint16_t ToLinear(uint16_t c, const SRGBTable & table, SRGBCurve curve)
+{
+    return c % 257 == 0 ? table[c / 257]
+                        : ToLinear(c / qreal(std::numeric_limits<uint16_t>::max()), curve);
+}
+
+static RGB16 ToLinear(const QColor & c, const SRGBTable & table, SRGBCurve curve)
+{
+    auto c64 = c.rgba64();
+    return RGB16( ToLinear(c64.red  (), table, curve),
+                  ToLinear(c64.green(), table, curve),
+                  ToLinear(c64.blue (), table, curve)  );
+}
+
+RGB16 SRGB_to_Linear(QColor c, SRGBCurve curve) { return ToLinear(c, Table(curve), curve); }
@@ -6,16 +6,89 @@
 
 #include <QOpenGLFunctions_4_5_Core>
 #include <QObject>
+#include <memory>
+#include <vector>
+#include <utility>
 
 using OpenGLFunctions = QOpenGLFunctions_4_5_Core;
 
+class QOpenGLContext;
+
 extern const double g_pi;
 extern const float g_pi_f;
 
-class VAO_Holder // gen VAO in all GL contexts in ctor; delete VAO in all GL contexts in dtor
-        : public QObject
+extern OpenGLFunctions * GLFunctions(); // of the current context
+
+// All contexts the scene is drawn in are in the share group of
+// QOpenGLContext::globalShareContext(), so buffers, programs and textures exist once;
+// only container objects (VAOs, FBOs) are per context
+extern void EnableGLContextSharing(); // call before QApplication is constructed
+extern bool SharesGLObjects(QOpenGLContext * context);
+
+// How triangles in PackedTriangle layout become primitives. GeometryShader: a point per
+// triangle with its vertices as attributes, expanded by a geometry shader. VertexPulling:
+// 3 vertices per triangle reading it from a shader storage buffer by gl_VertexID, as
+// geometry shaders are slow on many drivers and very slow on llvmpipe
+enum class VertexPipelineEnum { GeometryShader, VertexPulling };
+extern bool HasVertexShaderStorageBlocks(); // which VertexPulling needs
+
+class GLContextOwner // GLWidget or an offscreen context: something glass walls are drawn in
+{
+public:
+    virtual ~GLContextOwner() = default;
+    virtual QOpenGLContext * GLContext() const = 0;
+};
+
+extern std::vector<GLContextOwner *> g_GLContextOwners;
+
+// Owners get a dense slot index for per-context tables. Slots of dead owners are
+// reused with the next generation, and so is the slot of an owner that recreates its
+// context, so entries of a dead context are recognized as stale.
+// Container objects of a dead context die with it and needn't be deleted.
+struct GLContextSlot { uint32_t index, generation; };
+extern void RegisterGLContextOwner  (GLContextOwner * owner); // emits ComingToLife
+// Emits GoingToDie; call it with the owner's context current, so objects released then,
+// e.g. programs of its share group (see GLProgram()), are deleted in it
+extern void UnregisterGLContextOwner(GLContextOwner * owner);
+extern GLContextSlot CurrentGLContextSlot(); // the current context must have an owner
+extern bool IsAlive(GLContextSlot slot);
+extern void FlushDeletedVAOs(); // of the current context; call at the start of a frame
+
+class GLContextSignalEmitter : public QObject
 {
     Q_OBJECT
+    explicit GLContextSignalEmitter() = default;
+public:
+    static GLContextSignalEmitter & Instance();
+signals:
+    void GoingToDie(GLContextOwner *);
+    void ComingToLife(GLContextOwner *);
+};
+
+// Shader programs, or objects holding them or other GL objects of a share group (T), by
+// type and variant: constructed once per share group with a context of the group current,
+// on first use in any of its contexts, and found through a table of the current context
+// afterwards. Released when GoingToDie fires for the last owner that used the group,
+// so none outlives the contexts using it.
+// Shaders declare uniform locations explicitly, so there are none to look up
+struct GLProgramKey { const void * type; uint32_t variant; };
+extern void * FindGLProgram(GLProgramKey key); // nullptr if the share group has none yet
+extern void * AddGLProgram(GLProgramKey key, void * program, void (*release)(void *));
+
+template<class T> inline const char g_GLProgramType = 0; // its address tells T
+
+// Args construct T on first use in the share group
+template<class T, class... Args> T & GLProgram(uint32_t variant, Args &&... args)
+{
+    GLProgramKey key{ &g_GLProgramType<T>, variant };
+    if (auto program = FindGLProgram(key)) return *static_cast<T *>(program);
+    return *static_cast<T *>(AddGLProgram( key, new T(std::forward<Args>(args)...),
+                                           [](void * p){ delete static_cast<T *>(p); } ));
+}
+
+class VAO_Holder // VAO per GL context: generated on first use in the context,
+                 // queued for deletion in dtor and deleted by FlushDeletedVAOs()
+{
 public:
     explicit VAO_Holder();
     ~VAO_Holder();
@@ -24,8 +97,10 @@ public:
     VAO_Holder & operator=(const VAO_Holder & ) = delete;
     VAO_Holder & operator=(      VAO_Holder &&) = delete;
 
-    std::pair<GLuint, bool> GetVAO() const; // true if VAO is ready (VAO_SetReady() was called)
+    // Of the current context; true if VAO is ready (VAO_SetReady() was called)
+    std::pair<GLuint, bool> GetVAO();
     void VAO_SetReady();
+    void Invalidate(); // VAOs of all contexts need to be set up again
 private:
     struct Impl;
     std::unique_ptr<Impl> impl;
@@ -37,8 +112,66 @@ struct RGB16
     uint16_t r = 0, g = 0, b = 0;
     explicit constexpr RGB16(uint16_t r_, uint16_t g_, uint16_t b_) : r(r_), g(g_), b(b_) {}
 };
+
+struct PackedTriangle // as vertex buffers store triangles
+{
+    GLfloat vertices[6] = {};
+    RGB16 fillColor{0, 0, 0}, edgeColor{0, 0, 0};
+};
+
+struct PackedInstance // of a shape, or of the own triangles of a wall
+{
+    GLfloat transformation[6] = { 1, 0, 0,   // rows of an affine 2D transformation
+                                  0, 1, 0 };
+    RGB16 edgeColor{0, 0, 0}, fillColor{0, 0, 0};
+    GLuint ownColors = 1; // use colors of triangles rather than of the instance
+    GLuint wall = 0;      // index in WallBatch
+};
 #pragma pack(pop)
 
-extern RGB16 SRGB_to_Linear(QColor c);
+struct DrawArraysIndirectCommand { GLuint count, instanceCount, first, baseInstance; };
+
+// Vertex attributes of the bound VAO: PackedTriangle (0-2 vertices, 3 fill or edge color)
+// and PackedInstance (4 wall, 5-6 transformation, 7 edge color, 8 fill color, 9 own colors)
+// from buffers bound to the given binding points
+extern void SetupTriangleAttributes(OpenGLFunctions * f, GLuint binding, bool edgeColor);
+extern void SetupInstanceAttributes(OpenGLFunctions * f, GLuint binding);
+
+// Immutable storage mapped persistently: records are appended into the unused tail,
+// and the storage is recreated only to grow geometrically
+class AppendOnlyBuffer
+{
+public:
+    explicit AppendOnlyBuffer(size_t recordSize);
+    ~AppendOnlyBuffer(); // the buffer leaks if no context is current
+    AppendOnlyBuffer(const AppendOnlyBuffer & ) = delete;
+    AppendOnlyBuffer(      AppendOnlyBuffer &&) = delete;
+    AppendOnlyBuffer & operator=(const AppendOnlyBuffer & ) = delete;
+    AppendOnlyBuffer & operator=(      AppendOnlyBuffer &&) = delete;
+
+    // Uploads records [Count(), count) of data; true if the buffer was recreated,
+    // so VAOs referring to it must be set up again
+    bool Update(const void * data, size_t count);
+    // Count() grows by count records for the caller to write through Records();
+    // true if the buffer was recreated, as by Update()
+    bool Append(size_t count);
+    // Mapped memory of records from first on. Write only records no draw reads yet, and
+    // none that were there when Append() last recreated the buffer: the GPU copies them
+    void * Records(size_t first) const;
+    void Reset(); // no records; the next append creates new storage, so draws in flight
+                  // keep reading the old one
+    GLuint Buffer() const;
+    size_t Count() const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Gamma22 is pow(c, 2.2) that the rest of the tester assumes; Exact is the piecewise sRGB curve
+enum class SRGBCurve { Gamma22, Exact };
+
+// 8-bit components (every QColor made from ints) are looked up in a table,
+// others are computed, with the same results bit for bit
+extern RGB16 SRGB_to_Linear(QColor c, SRGBCurve curve = SRGBCurve::Gamma22);
 
 #endif // GLDRAWINGFACILITIES_H
@@ -4,41 +4,37 @@
 #include <QOpenGLWidget>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLBuffer>
-#include <QOpenGLShaderProgram>
 
 #include "GLDrawingFacilities.h"
+#include "SceneRenderer.h"
 
-class GLWidget : public QOpenGLWidget
+class GLWidget : public QOpenGLWidget, public GLContextOwner
 {
     Q_OBJECT
 public:
-    enum class RenderStrategyEnum { WBOIT, CODB, Additive, AdditiveEP };
+    using RenderStrategyEnum = SceneRenderer::RenderStrategyEnum;
     explicit GLWidget(RenderStrategyEnum strategy, QWidget * parent);
     ~GLWidget() override;
 
-    [[nodiscard]] GLuint GenVAO();
-    [[nodiscard]] bool DeleteVAO(GLuint vao);
+    QOpenGLContext * GLContext() const override { return context(); }
+
+    RenderStrategyEnum Strategy() const;
+    // See SceneRenderer::Accumulation(); repaints
+    void Accumulation(int scale, GLsizei samples);
+    QString PassTimingsSummary() const; // rolling averages of GPU time per pass
+    uint64_t ShownRevision() const; // GlassWall::Revision() of the last frame painted
+    uint64_t PaintedFrames() const; // of the scene, placeholders painted during warm-up not counted
+signals:
+    void PassTimingsChanged();
 protected:
     void initializeGL() override;
     void resizeGL(int width, int height) override;
     void paintGL() override;
 
 private:
+    void CollectPassTimings(); // context must be current
     struct Impl;
     std::unique_ptr<Impl> impl;
 };
 
-extern std::vector<GLWidget *> g_GLWidgets;
-
-class GLWidgetSignalEmitter : public QObject
-{
-    Q_OBJECT
-    explicit GLWidgetSignalEmitter() = default;
-public:
-    static GLWidgetSignalEmitter & Instance();
-signals:
-    void GoingToDie(GLWidget *);
-    void ComingToLife(GLWidget *);
-};
-
 #endif // GLWidget_H
@@ -0,0 +1,168 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "GPUPassTimer.h"
+
+#include <algorithm>
+#include <deque>
+
+Q_LOGGING_CATEGORY(lcPassTimings, "wboit.passtimings", QtWarningMsg)
+
+struct GPUPassTimer::Impl
+{
+    struct QuerySet
+    {
+        std::array<GLuint, passCount> queries{};
+        std::array<bool  , passCount> used{};
+    };
+    std::array<QuerySet, framesInFlight> sets;
+    std::deque<size_t> pending;              // indices of sets, oldest first
+    std::optional<size_t> recording;         // set of the current frame
+    std::optional<Pass> activePass;
+
+    struct History // of one pass
+    {
+        std::array<double, averagedFrames> ms{};
+        size_t count = 0, next = 0;
+        double sum = 0;
+
+        void Push(double v)
+        {
+            if (count == averagedFrames) sum -= ms[next]; else ++count;
+            ms[next] = v; sum += v;
+            next = (next + 1) % averagedFrames;
+        }
+    };
+    std::array<History, passCount> history;
+
+    bool generated = false;
+};
+
+const char * GPUPassTimer::PassName(Pass pass)
+{
+    switch (pass)
+    {
+    case Pass::Opaque           : return "opaque";
+    case Pass::ClearAccumulation: return "clear";
+    case Pass::Transparent      : return "transparent";
+    case Pass::Composite        : return "composite";
+    }
+    assert(false); return "";
+}
+
+GPUPassTimer::GPUPassTimer() : impl(std::make_unique<Impl>()) {}
+
+GPUPassTimer::~GPUPassTimer() = default;
+
+void GPUPassTimer::GenGLResources()
+{
+    assert(!impl->generated);
+    auto f = GLFunctions();
+    for (auto & set : impl->sets)
+        f->glGenQueries(static_cast<GLsizei>(passCount), set.queries.data());
+    impl->generated = true;
+}
+
+void GPUPassTimer::DeleteGLResources()
+{
+    if (!impl->generated) return;
+    auto f = GLFunctions();
+    for (auto & set : impl->sets)
+        f->glDeleteQueries(static_cast<GLsizei>(passCount), set.queries.data());
+    impl->pending.clear();
+    impl->recording.reset();
+    impl->generated = false;
+}
+
+void GPUPassTimer::BeginFrame()
+{
+    assert(!impl->recording && !impl->activePass);
+    if (!impl->generated || impl->pending.size() == framesInFlight) return;
+
+    // Sets are used round robin, so the one after the newest pending is free
+    size_t i = impl->pending.empty() ? 0 : (impl->pending.back() + 1) % framesInFlight;
+    impl->sets[i].used.fill(false);
+    impl->recording = i;
+}
+
+void GPUPassTimer::EndFrame()
+{
+    assert(!impl->activePass);
+    if (!impl->recording) return;
+    auto & used = impl->sets[*impl->recording].used;
+    if (std::find(used.begin(), used.end(), true) != used.end())
+        impl->pending.push_back(*impl->recording);
+    impl->recording.reset();
+}
+
+void GPUPassTimer::Begin(Pass pass)
+{
+    assert(!impl->activePass);
+    if (!impl->recording) return;
+    auto & set = impl->sets[*impl->recording];
+    auto p = static_cast<size_t>(pass);
+    assert(!set.used[p]);
+    GLFunctions()->glBeginQuery(GL_TIME_ELAPSED, set.queries[p]);
+    set.used[p] = true;
+    impl->activePass = pass;
+}
+
+void GPUPassTimer::End()
+{
+    if (!impl->recording) return;
+    assert(impl->activePass);
+    GLFunctions()->glEndQuery(GL_TIME_ELAPSED);
+    impl->activePass.reset();
+}
+
+bool GPUPassTimer::Collect()
+{
+    auto f = GLFunctions();
+    bool ret = false;
+    while (!impl->pending.empty())
+    {
+        auto & set = impl->sets[impl->pending.front()];
+
+        // Queries complete in order, so the last one used tells about the whole set
+        size_t last = passCount;
+        while (!set.used[--last]) {}
+        GLint available = GL_FALSE;
+        f->glGetQueryObjectiv(set.queries[last], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        for (size_t p = 0; p != passCount; ++p)
+        {
+            if (!set.used[p]) continue;
+            GLuint64 ns = 0;
+            f->glGetQueryObjectui64v(set.queries[p], GL_QUERY_RESULT, &ns);
+            impl->history[p].Push(static_cast<double>(ns) * 1e-6);
+        }
+        impl->pending.pop_front();
+        ret = true;
+    }
+    return ret;
+}
+
+bool GPUPassTimer::Pending() const { return !impl->pending.empty(); }
+
+std::array<std::optional<double>, GPUPassTimer::passCount> GPUPassTimer::Averages() const
+{
+    std::array<std::optional<double>, passCount> ret;
+    for (size_t p = 0; p != passCount; ++p)
+        if (auto & h = impl->history[p]; h.count) ret[p] = h.sum / h.count;
+    return ret;
+}
+
+QString GPUPassTimer::Summary() const
+{
+    QString ret;
+    auto averages = Averages();
+    for (size_t p = 0; p != passCount; ++p)
+    {
+        if (!averages[p]) continue;
+        if (!ret.isEmpty()) ret += QStringLiteral(", ");
+        ret += QStringLiteral("%1 %2").arg(PassName(static_cast<Pass>(p)))
+                                      .arg(*averages[p], 0, 'f', 3);
+    }
+    return ret.isEmpty() ? ret : ret + QStringLiteral(" ms");
+}
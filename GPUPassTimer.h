@@ -0,0 +1,59 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef GPUPASSTIMER_H
+#define GPUPASSTIMER_H
+
+#include <array>
+#include <optional>
+#include <QString>
+#include <QLoggingCategory>
+
+#include "GLDrawingFacilities.h"
+
+// Per widget summaries once a second; enable with QT_LOGGING_RULES="wboit.passtimings.info=true"
+Q_DECLARE_LOGGING_CATEGORY(lcPassTimings)
+
+// Measures GPU time of every render pass with GL_TIME_ELAPSED queries.
+// Results are read back frames later, when they are available, so the pipeline
+// never stalls; if all query sets are still in flight a frame isn't measured.
+// All methods except ctor, dtor and getters must be called with the context current.
+class GPUPassTimer
+{
+public:
+    enum class Pass { Opaque, ClearAccumulation, Transparent, Composite };
+    static constexpr size_t passCount = 4;
+    static const char * PassName(Pass pass);
+
+    static constexpr size_t framesInFlight = 4; // query sets
+    static constexpr size_t averagedFrames = 60;
+
+    explicit GPUPassTimer();
+    ~GPUPassTimer();
+    GPUPassTimer(const GPUPassTimer & ) = delete;
+    GPUPassTimer(      GPUPassTimer &&) = delete;
+    GPUPassTimer & operator=(const GPUPassTimer & ) = delete;
+    GPUPassTimer & operator=(      GPUPassTimer &&) = delete;
+
+    void GenGLResources();
+    void DeleteGLResources();
+
+    void BeginFrame();
+    void EndFrame();
+    void Begin(Pass pass); // passes can't be nested
+    void End();
+
+    bool Collect();       // reads back finished frames, true if averages changed
+    bool Pending() const; // some frames wait for Collect()
+
+    // Milliseconds averaged over the last averagedFrames measured frames;
+    // nullopt for passes that weren't measured
+    std::array<std::optional<double>, passCount> Averages() const;
+    QString Summary() const; // e.g. "opaque 0.120, transparent 0.410 ms"
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // GPUPASSTIMER_H
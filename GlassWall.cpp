@@ -4,7 +4,10 @@
 #include "GlassWall.h"
 
 #include <map>
-#include <QOpenGLShaderProgram>
+#include <algorithm>
+#include <QOpenGLContext>
+
+#include "ShaderProgram.h"
 
 struct GlassWall::Impl
 {
@@ -12,7 +15,7 @@ struct GlassWall::Impl
         : m_depthLevel(depthLevel), m_opacity(opacity)
         , m_transparent(transparent), m_visible(visible)
     {
-        if (opacity < 0 || opacity > 1) throw GlassWallException_CantConstruct();
+        if (!(opacity >= 0 && opacity <= 1)) throw GlassWallException_CantConstruct(); // NaN too
         UpdateDepthsOnConctruction();
     }
     int m_depthLevel; float m_opacity; bool m_transparent; bool m_visible;
@@ -20,21 +23,48 @@ struct GlassWall::Impl
 
     static void UpdateDepths();
     void UpdateDepthsOnConctruction();
-    GLfloat MyDepth();
-
-    std::vector<QVector2D> m_vertices;
-    std::vector<QColor> m_edgeColors;
-    std::vector<QColor> m_fillColors;
-
-    bool m_vboNeedsToBeCreated = true;
-    bool m_vboNeedsToBeReallocated = true;
-    std::optional<QOpenGLBuffer> m_tri_vbo;
+    GLfloat MyDepth() const;
+
+    // As the GPU sees them: colors are linear. Own triangles are drawn by instance 0,
+    // shapes by their instances; a command draws a run of instances of one triangle range
+    std::vector<PackedTriangle> m_triangles;
+    std::vector<PackedInstance> m_instances = { PackedInstance() };
+    std::vector<DrawArraysIndirectCommand> m_commands;
+    std::vector<size_t> m_commandEnds; // count of triangles drawn by commands up to this one
+    std::vector<ShapeRange> m_shapes;
+
+    // Geometry of a scene file is read from its mapping, kept alive by m_storage,
+    // until the wall changes and Own() copies it into the vectors above
+    std::shared_ptr<const void> m_storage;
+    PackedArray<PackedTriangle> m_storedTriangles;
+    PackedArray<PackedInstance> m_storedInstances;
+    PackedArray<DrawArraysIndirectCommand> m_storedCommands;
+    PackedArray<ShapeRange> m_storedShapes;
+    void Own();
+
+    template<class T> static PackedArray<T> View(const std::vector<T> & v)
+    { return PackedArray<T>(v.data(), v.size()); }
+    PackedArray<PackedTriangle> Triangles() const
+    { return m_storage ? m_storedTriangles : View(m_triangles); }
+    PackedArray<PackedInstance> Instances() const
+    { return m_storage ? m_storedInstances : View(m_instances); }
+    PackedArray<DrawArraysIndirectCommand> Commands() const
+    { return m_storage ? m_storedCommands : View(m_commands); }
+    PackedArray<ShapeRange> Shapes() const
+    { return m_storage ? m_storedShapes : View(m_shapes); }
+
+    void AddCommand(GLuint first, GLuint count, GLuint instance);
+
+    // One buffer of each for all contexts: they share objects (see EnableGLContextSharing()),
+    // while VAOs are per context
+    AppendOnlyBuffer m_vbo{sizeof(PackedTriangle)}, m_instanceVBO{sizeof(PackedInstance)};
     VAO_Holder m_triFaces_vaoHolder, m_triEdges_vaoHolder;
+    VAO_Holder m_pulling_vaoHolder; // instances only: vertices read the buffer themselves
 
-    void CreateVBO();
-    void ReallocateVBO();
-    void SetupTriFacesVAO(GLuint vao, OpenGLFunctions * f);
-    void SetupTriEdgesVAO(GLuint vao, OpenGLFunctions * f);
+    void UpdateVBOs(); // uploads triangles and instances added since the last call
+    void SetupTriVAO(GLuint vao, OpenGLFunctions * f, bool edges);
+    void SetupPullingVAO(GLuint vao, OpenGLFunctions * f);
+    void DrawTriangles(OpenGLFunctions * f, VertexPipelineEnum pipeline, bool edges);
 
     int  DepthLevel(       ) const { return m_depthLevel;                }
     void DepthLevel(int lvl)       { m_depthLevel = lvl; UpdateDepths(); }
@@ -49,15 +79,24 @@ struct GlassWall::Impl
 
     void AddTriangle( QVector2D a, QVector2D b, QVector2D c,
                       QColor edgeColor, QColor fillColor     );
-
-    void DrawNonTransparent        (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForWBOIT   (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForCODB    (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForAdditive(OpenGLFunctions * f, const QMatrix3x3 & projMat);
+    ShapeId AddShape(const std::vector<QVector2D> & vertices);
+    void AddShapeInstance( ShapeId shape, const QMatrix3x3 & transformation,
+                           QColor edgeColor, QColor fillColor                );
+
+    void DrawNonTransparent        ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForWBOIT   ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForWBOITLog( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForCODB    ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForAdditive( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
 private:
-    enum class TransparentStrategy { WBOIT, CODB, Additive };
+    enum class TransparentStrategy { WBOIT, WBOITLog, CODB, Additive };
     void DrawTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
-                          TransparentStrategy strategy                     );
+                          VertexPipelineEnum pipeline, TransparentStrategy strategy );
 };
 
 GlassWall::GlassWall(int depthLevel, float opacity, bool transparent, bool visible)
@@ -67,6 +106,7 @@ static std::map<int, std::unique_ptr<GlassWall>> g_gwalls;
 // iterate from far to near
 static std::map<int, std::unique_ptr<GlassWall>>::reverse_iterator g_gwallsIter;
 static float g_gwalls_k, g_gwalls_b; // depth = k * depthLevel + b;
+static uint64_t g_revision = 0, g_geometryRevision = 0, g_wallSetRevision = 0;
 
 static void CalcCoefsFromMinAndMax(int min, int max)
 {
@@ -100,133 +140,151 @@ void GlassWall::Impl::UpdateDepthsOnConctruction()
     CalcCoefsFromMinAndMax(min, max);
 }
 
-GLfloat GlassWall::Impl::MyDepth()
+GLfloat GlassWall::Impl::MyDepth() const
 {
     return g_gwalls_k * m_depthLevel + g_gwalls_b;
 }
 
-void GlassWall::Impl::CreateVBO()
+void GlassWall::Impl::UpdateVBOs()
 {
-    m_tri_vbo.emplace(QOpenGLBuffer::VertexBuffer);
-    if (!m_tri_vbo->create()) assert(false);
-    if (!m_tri_vbo->bind()) assert(false);
-    m_tri_vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-
-    m_vboNeedsToBeCreated = false;
+    auto triangles = Triangles(); auto instances = Instances();
+    bool recreated = m_vbo.Update(triangles.data(), triangles.size());
+    recreated = m_instanceVBO.Update(instances.data(), instances.size()) || recreated;
+    if (recreated)
+    {
+        m_triFaces_vaoHolder.Invalidate(); m_triEdges_vaoHolder.Invalidate();
+        m_pulling_vaoHolder.Invalidate();
+    }
 }
 
-void GlassWall::Impl::ReallocateVBO()
+void GlassWall::Impl::SetupTriVAO(GLuint vao, OpenGLFunctions * f, bool edges)
 {
-    assert(m_vertices.size() == m_edgeColors.size() * 3);
-    assert(m_fillColors.size() == m_edgeColors.size());
-
-    size_t posOffset = 0,
-           fcOffset =            m_vertices  .size() * sizeof(float) * 2,
-           ecOffset = fcOffset + m_fillColors.size() * sizeof(RGB16),
-           size     = ecOffset + m_edgeColors.size() * sizeof(RGB16);
-    std::vector<uint8_t> data(size);
+    SetupPullingVAO(vao, f); // instances, plus triangles as attributes
+    f->glBindVertexBuffer(0, m_vbo.Buffer(), 0, sizeof(PackedTriangle));
+    SetupTriangleAttributes(f, 0, edges);
+    (edges ? m_triEdges_vaoHolder : m_triFaces_vaoHolder).VAO_SetReady();
+}
 
-    float *  p_ptr = reinterpret_cast<float *>(&data[posOffset]);
-    RGB16 * fc_ptr = reinterpret_cast<RGB16 *>(&data[ fcOffset]);
-    RGB16 * ec_ptr = reinterpret_cast<RGB16 *>(&data[ ecOffset]);
+void GlassWall::Impl::SetupPullingVAO(GLuint vao, OpenGLFunctions * f)
+{
+    f->glBindVertexArray(vao);
+    f->glBindVertexBuffer(1, m_instanceVBO.Buffer(), 0, sizeof(PackedInstance));
+    SetupInstanceAttributes(f, 1);
+}
 
-    auto it_ec = m_edgeColors.cbegin(); auto it_fc = m_fillColors.cbegin();
-    for (auto it_v = m_vertices.cbegin(); it_v != m_vertices.cend();)
+void GlassWall::Impl::AddCommand(GLuint first, GLuint count, GLuint instance)
+{
+    auto last = m_commands.empty() ? nullptr : &m_commands.back();
+    if (   last && instance && last->baseInstance && last->first == first
+        && last->count == count && last->baseInstance + last->instanceCount == instance)
+        ++last->instanceCount; // the next instance of the same shape
+    else if (last && !instance && !last->baseInstance && last->first + last->count == first)
+        last->count += count;  // the next own triangle
+    else
     {
-        for (uint8_t i = 0; i != 3; ++i)
-        { *p_ptr++ = it_v->x(); *p_ptr++ = it_v->y(); ++it_v; }
-
-        *fc_ptr++ = SRGB_to_Linear(*it_fc++);
-        *ec_ptr++ = SRGB_to_Linear(*it_ec++);
+        m_commands.push_back({ count, 1, first, instance });
+        m_commandEnds.push_back(m_commandEnds.empty() ? 0 : m_commandEnds.back());
     }
-    m_tri_vbo->allocate(data.data(), static_cast<int>(data.size()));
+    m_commandEnds.back() += count;
+}
 
-    m_vboNeedsToBeReallocated = false;
+void GlassWall::Impl::Own()
+{
+    if (!m_storage) return;
+    m_triangles.assign(m_storedTriangles.begin(), m_storedTriangles.end());
+    m_instances.assign(m_storedInstances.begin(), m_storedInstances.end());
+    m_commands .assign(m_storedCommands .begin(), m_storedCommands .end());
+    m_shapes   .assign(m_storedShapes   .begin(), m_storedShapes   .end());
+    m_storage.reset();
 }
 
-void GlassWall::Impl::SetupTriFacesVAO(GLuint vao, OpenGLFunctions * f)
+void GlassWall::Impl::AddTriangle( QVector2D a, QVector2D b, QVector2D c,
+                                   QColor edgeColor, QColor fillColor     )
 {
-    f->glBindVertexArray(vao);
-    assert(m_tri_vbo->isCreated());
-    if (!m_tri_vbo->bind()) assert(false);
-
-    static constexpr GLsizei stride = sizeof(float) * 6;
-    static const GLvoid * offset0 = reinterpret_cast<const void *>(0                );
-    static const GLvoid * offset1 = reinterpret_cast<const void *>(2 * sizeof(float));
-    static const GLvoid * offset2 = reinterpret_cast<const void *>(4 * sizeof(float));
-    f->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, offset0);
-    f->glEnableVertexAttribArray(0);
-    f->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, offset1);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, offset2);
-    f->glEnableVertexAttribArray(2);
-
-    auto fcOffset = reinterpret_cast<void *>(m_vertices.size() * sizeof(float) * 2);
-
-    f->glVertexAttribPointer(3, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(RGB16), fcOffset);
-    f->glEnableVertexAttribArray(3);
-
-    m_triFaces_vaoHolder.VAO_SetReady();
+    Own();
+    ++g_revision; ++g_geometryRevision;
+    PackedTriangle t;
+    t.vertices[0] = a.x(); t.vertices[1] = a.y();
+    t.vertices[2] = b.x(); t.vertices[3] = b.y();
+    t.vertices[4] = c.x(); t.vertices[5] = c.y();
+    t.fillColor = SRGB_to_Linear(fillColor);
+    t.edgeColor = SRGB_to_Linear(edgeColor);
+    m_triangles.push_back(t);
+    AddCommand(static_cast<GLuint>(m_triangles.size() - 1), 1, 0);
 }
 
-void GlassWall::Impl::SetupTriEdgesVAO(GLuint vao, OpenGLFunctions * f)
+GlassWall::ShapeId GlassWall::Impl::AddShape(const std::vector<QVector2D> & vertices)
 {
-    f->glBindVertexArray(vao);
-    assert(m_tri_vbo->isCreated());
-    if (!m_tri_vbo->bind()) assert(false);
-
-    static constexpr GLsizei stride = sizeof(float) * 6;
-    static const GLvoid * offset0 = reinterpret_cast<const void *>(0                );
-    static const GLvoid * offset1 = reinterpret_cast<const void *>(2 * sizeof(float));
-    static const GLvoid * offset2 = reinterpret_cast<const void *>(4 * sizeof(float));
-    f->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, offset0);
-    f->glEnableVertexAttribArray(0);
-    f->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, offset1);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, offset2);
-    f->glEnableVertexAttribArray(2);
-
-    auto ecOffset = reinterpret_cast<void *>( m_vertices.size() * sizeof(float) * 2 +
-                                              m_fillColors.size() * sizeof(RGB16)     );
-
-    f->glVertexAttribPointer(3, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(RGB16), ecOffset);
-    f->glEnableVertexAttribArray(3);
-
-    m_triEdges_vaoHolder.VAO_SetReady();
+    assert(vertices.size() % 3 == 0);
+    Own();
+    ++g_geometryRevision;
+    m_shapes.push_back({ static_cast<GLuint>(m_triangles.size()),
+                         static_cast<GLuint>(vertices.size() / 3) });
+    for (auto it = vertices.cbegin(); it != vertices.cend();)
+    {
+        auto & t = m_triangles.emplace_back(); // colors come from instances
+        for (uint8_t v = 0; v != 3; ++v, ++it)
+        { t.vertices[2 * v] = it->x(); t.vertices[2 * v + 1] = it->y(); }
+    }
+    return m_shapes.size() - 1;
 }
 
-void GlassWall::Impl::AddTriangle( QVector2D a, QVector2D b, QVector2D c,
-                                   QColor edgeColor, QColor fillColor     )
+void GlassWall::Impl::AddShapeInstance( ShapeId shape, const QMatrix3x3 & transformation,
+                                        QColor edgeColor, QColor fillColor                )
 {
-    m_vertices.push_back(a); m_vertices.push_back(b); m_vertices.push_back(c);
-    m_edgeColors.push_back(edgeColor);
-    m_fillColors.push_back(fillColor);
-    m_vboNeedsToBeReallocated = true;
+    Own();
+    assert(shape < m_shapes.size());
+    ++g_revision; ++g_geometryRevision;
+    auto & instance = m_instances.emplace_back();
+    for (int row = 0; row != 2; ++row)
+        for (int col = 0; col != 3; ++col)
+            instance.transformation[3 * row + col] = transformation(row, col);
+    instance.edgeColor = SRGB_to_Linear(edgeColor);
+    instance.fillColor = SRGB_to_Linear(fillColor);
+    instance.ownColors = 0;
+    AddCommand( m_shapes[shape].first, m_shapes[shape].count,
+                static_cast<GLuint>(m_instances.size() - 1)  );
 }
 
 
 
+// Programs are built once per share group in whatever of its contexts comes first
+// and used in all of them, see GLProgram()
 struct GlassWall_GLProgram {
-    QOpenGLShaderProgram p;
+    ShaderProgram p;
     static constexpr auto vs_source =
-            "#version 450 core                                                     \n"
-            "layout (location = 0) in vec2 vertex0;                                \n"
-            "layout (location = 1) in vec2 vertex1;                                \n"
-            "layout (location = 2) in vec2 vertex2;                                \n"
-            "                                                                      \n"
-            "layout (location = 3) in vec3 color;                                  \n"
-            "                                                                      \n"
-            "out vec2 gs_vertex0;                                                  \n"
-            "out vec2 gs_vertex1;                                                  \n"
-            "out vec2 gs_vertex2;                                                  \n"
-            "                                                                      \n"
-            "out vec3 gs_color;                                                    \n"
-            "                                                                      \n"
-            "void main()                                                           \n"
-            "{                                                                     \n"
-            "    gs_vertex0 = vertex0; gs_vertex1 = vertex1; gs_vertex2 = vertex2; \n"
-            "    gs_color = color;                                                 \n"
-            "}                                                                     \n";
+            "#version 450 core                                                              \n"
+            "layout (location = 0) in vec2 vertex0;                                         \n"
+            "layout (location = 1) in vec2 vertex1;                                         \n"
+            "layout (location = 2) in vec2 vertex2;                                         \n"
+            "                                                                               \n"
+            "layout (location = 3) in vec3 color;                                           \n"
+            "                                                                               \n"
+            "layout (location = 5) in vec3 instanceTr0; // rows of the transformation       \n"
+            "layout (location = 6) in vec3 instanceTr1;                                     \n"
+            "layout (location = 7) in vec3 instanceEdgeColor;                               \n"
+            "layout (location = 8) in vec3 instanceFillColor;                               \n"
+            "layout (location = 9) in uint ownColors;                                       \n"
+            "                                                                               \n"
+            "layout (location = 3) uniform bool edges;                                      \n"
+            "                                                                               \n"
+            "out vec2 gs_vertex0;                                                           \n"
+            "out vec2 gs_vertex1;                                                           \n"
+            "out vec2 gs_vertex2;                                                           \n"
+            "                                                                               \n"
+            "out vec3 gs_color;                                                             \n"
+            "                                                                               \n"
+            "vec2 Instance(vec2 v)                                                          \n"
+            "{ return vec2(dot(instanceTr0, vec3(v, 1)), dot(instanceTr1, vec3(v, 1))); }   \n"
+            "                                                                               \n"
+            "void main()                                                                    \n"
+            "{                                                                              \n"
+            "    gs_vertex0 = Instance(vertex0);                                            \n"
+            "    gs_vertex1 = Instance(vertex1);                                            \n"
+            "    gs_vertex2 = Instance(vertex2);                                            \n"
+            "    gs_color = ownColors != 0 ? color                                          \n"
+            "                              : edges ? instanceEdgeColor : instanceFillColor; \n"
+            "}                                                                              \n";
     static constexpr auto gs_source =
             "#version 450 core                                              \n"
             "layout (points) in;                                            \n"
@@ -245,18 +303,48 @@ struct GlassWall_GLProgram {
             "                                                               \n"
             "void main()                                                    \n"
             "{                                                              \n"
-            "    // Provoking vertex:                                       \n"
+            "    // Outputs are undefined after EmitVertex(), so the color  \n"
+            "    // is set for every vertex, whichever is the provoking one \n"
             "    gl_Position = vec4(  ( tr * vec3(gs_vertex0[0], 1) ).xy,   \n"
             "                         d, 1                                  \n"
             "                      ); fs_color = gs_color[0]; EmitVertex(); \n"
             "    gl_Position = vec4(  ( tr * vec3(gs_vertex1[0], 1) ).xy,   \n"
             "                         d, 1                                  \n"
-            "                      ); EmitVertex();                         \n"
+            "                      ); fs_color = gs_color[0]; EmitVertex(); \n"
             "    gl_Position = vec4(  ( tr * vec3(gs_vertex2[0], 1) ).xy,   \n"
             "                         d, 1                                  \n"
-            "                      ); EmitVertex();                         \n"
-            "    EmitVertex(); EndPrimitive();                              \n"
+            "                      ); fs_color = gs_color[0]; EmitVertex(); \n"
+            "    EndPrimitive();                                            \n"
             "}                                                              \n";
+    // Vertex pulling: 3 vertices per triangle, no geometry shader. The buffer holds
+    // PackedTriangle records, 9 uints each: 6 floats, then fill RG, fill B + edge R, edge GB
+    static constexpr auto vs_source_pulling =
+            "#version 450 core                                                             \n"
+            "layout (std430, binding = 1) readonly buffer Triangles { uint t[]; };         \n"
+            "                                                                              \n"
+            "layout (location = 5) in vec3 instanceTr0; // rows of the transformation      \n"
+            "layout (location = 6) in vec3 instanceTr1;                                    \n"
+            "layout (location = 7) in vec3 instanceEdgeColor;                              \n"
+            "layout (location = 8) in vec3 instanceFillColor;                              \n"
+            "layout (location = 9) in uint ownColors;                                      \n"
+            "                                                                              \n"
+            "layout (location = 0) uniform float d;                                        \n"
+            "layout (location = 1) uniform mat3 tr;                                        \n"
+            "layout (location = 3) uniform bool edges;                                     \n"
+            "                                                                              \n"
+            "out flat vec3 fs_color;                                                       \n"
+            "                                                                              \n"
+            "void main()                                                                   \n"
+            "{                                                                             \n"
+            "    int i = 9 * (gl_VertexID / 3), v = i + 2 * (gl_VertexID % 3);             \n"
+            "    vec3 vertex = vec3(uintBitsToFloat(uvec2(t[v], t[v + 1])), 1);            \n"
+            "    vertex.xy = vec2(dot(instanceTr0, vertex), dot(instanceTr1, vertex));     \n"
+            "    gl_Position = vec4((tr * vertex).xy, d, 1);                               \n"
+            "    vec2 c0 = unpackUnorm2x16(t[i + 6]), c1 = unpackUnorm2x16(t[i + 7]),      \n"
+            "         c2 = unpackUnorm2x16(t[i + 8]);                                      \n"
+            "    fs_color = ownColors == 0 ? edges ? instanceEdgeColor : instanceFillColor \n"
+            "                              : edges ? vec3(c1.y, c2)    : vec3(c0, c1.x);   \n"
+            "}                                                                             \n";
     static constexpr auto fs_source_NT =
             "#version 450 core                 \n"
             "                                  \n"
@@ -264,16 +352,40 @@ struct GlassWall_GLProgram {
             "out vec3 color;                   \n"
             "                                  \n"
             "void main() { color = fs_color; } \n";
+    // WBOIT(Log) marks tiles of 16x16 accumulation pixels with visible fragments in the
+    // tile mask SceneRenderer binds, so its composite skips the others
     static constexpr auto fs_source_WBOIT =
-            "#version 450 core                                               \n"
-            "                                                                \n"
-            "in vec3 fs_color;                                               \n"
-            "                                                                \n"
-            "layout (location = 0) out vec4 outData;                         \n"
-            "layout (location = 1) out float alpha;                          \n"
-            "                                                                \n"
-            "layout (location = 2) uniform float w;                          \n"
-            "void main() { outData = vec4(w * fs_color, w); alpha = 1 - w; } \n";
+            "#version 450 core                                                  \n"
+            "layout (early_fragment_tests) in;                                  \n"
+            "                                                                   \n"
+            "in vec3 fs_color;                                                  \n"
+            "                                                                   \n"
+            "layout (location = 0) out vec4 outData;                            \n"
+            "layout (location = 1) out float alpha;                             \n"
+            "layout (binding = 0, r8ui) uniform writeonly uimage2D tileMask;    \n"
+            "                                                                   \n"
+            "layout (location = 2) uniform float w;                             \n"
+            "void main() {                                                      \n"
+            "    outData = vec4(w * fs_color, w); alpha = 1 - w;                \n"
+            "    imageStore(tileMask, ivec2(gl_FragCoord.xy) / 16, uvec4(1));   \n"
+            "}                                                                  \n";
+    // Weights are -log(1 - opacity), so the sum of weights also gives the revealage:
+    // exp(-sum) is the product of (1 - opacity); all in one target with additive blending
+    static constexpr auto fs_source_WBOITLog =
+            "#version 450 core                                                  \n"
+            "layout (early_fragment_tests) in;                                  \n"
+            "                                                                   \n"
+            "in vec3 fs_color;                                                  \n"
+            "                                                                   \n"
+            "layout (location = 0) out vec4 outData;                            \n"
+            "layout (binding = 0, r8ui) uniform writeonly uimage2D tileMask;    \n"
+            "                                                                   \n"
+            "layout (location = 2) uniform float opacity;                       \n"
+            "void main() {                                                      \n"
+            "    float w = -log(1 - min(opacity, 0.999)); // finite for opaque  \n"
+            "    outData = vec4(w * fs_color, w);                               \n"
+            "    imageStore(tileMask, ivec2(gl_FragCoord.xy) / 16, uvec4(1));   \n"
+            "}                                                                  \n";
     static constexpr auto fs_source_CODB =
             "#version 450 core                          \n"
             "                                           \n"
@@ -291,134 +403,148 @@ struct GlassWall_GLProgram {
             "                                            \n"
             "void main() { color = vec3(fs_color * w); } \n";
 
-    enum class Mode { NT, WBOIT, CODB, Additive };
-    explicit GlassWall_GLProgram(Mode mode)
+    enum class Mode { NT, WBOIT, WBOITLog, CODB, Additive };
+    explicit GlassWall_GLProgram(Mode mode, VertexPipelineEnum pipeline)
     {
-        if (!p.addShaderFromSourceCode(QOpenGLShader::Vertex  , vs_source)) assert(false);
-        if (!p.addShaderFromSourceCode(QOpenGLShader::Geometry, gs_source)) assert(false);
+        if (pipeline == VertexPipelineEnum::VertexPulling)
+        {
+            p.AddShader(GL_VERTEX_SHADER, vs_source_pulling);
+        }
+        else
+        {
+            p.AddShader(GL_VERTEX_SHADER  , vs_source);
+            p.AddShader(GL_GEOMETRY_SHADER, gs_source);
+        }
         switch (mode)
         {
         case Mode::NT:
-            if (!p.addShaderFromSourceCode(QOpenGLShader::Fragment, fs_source_NT       ))
-                assert(false);
+            p.AddShader(GL_FRAGMENT_SHADER, fs_source_NT       );
             break;
         case Mode::WBOIT:
-            if (!p.addShaderFromSourceCode(QOpenGLShader::Fragment, fs_source_WBOIT    ))
-                assert(false);
+            p.AddShader(GL_FRAGMENT_SHADER, fs_source_WBOIT    );
+            break;
+        case Mode::WBOITLog:
+            p.AddShader(GL_FRAGMENT_SHADER, fs_source_WBOITLog );
             break;
         case Mode::CODB:
-            if (!p.addShaderFromSourceCode(QOpenGLShader::Fragment, fs_source_CODB     ))
-                assert(false);
+            p.AddShader(GL_FRAGMENT_SHADER, fs_source_CODB     );
             break;
         case Mode::Additive:
-            if (!p.addShaderFromSourceCode(QOpenGLShader::Fragment, fs_source_Additive ))
-                assert(false);
+            p.AddShader(GL_FRAGMENT_SHADER, fs_source_Additive );
             break;
         }
-        if (!p.link()) assert(false);
+        p.Link();
+    }
+
+    static ShaderProgram & Get(Mode mode, VertexPipelineEnum pipeline)
+    {
+        auto variant = 2 * static_cast<uint32_t>(mode) + static_cast<uint32_t>(pipeline);
+        return GLProgram<GlassWall_GLProgram>(variant, mode, pipeline).p;
     }
 };
 
-void GlassWall::Impl::DrawNonTransparent(OpenGLFunctions * f, const QMatrix3x3 & projMat)
+void GlassWall::Impl::DrawTriangles(OpenGLFunctions * f, VertexPipelineEnum pipeline, bool edges)
 {
-    if (!m_visible || m_vertices.empty()) return;
-    if (m_vboNeedsToBeCreated) CreateVBO();
-    if (m_vboNeedsToBeReallocated) ReallocateVBO();
+    GLuint verticesPerTriangle = 1; GLenum mode = GL_POINTS;
+    if (pipeline == VertexPipelineEnum::VertexPulling)
+    {
+        auto [vao, ready] = m_pulling_vaoHolder.GetVAO();
+        if (!ready) { SetupPullingVAO(vao, f); m_pulling_vaoHolder.VAO_SetReady(); }
+        else f->glBindVertexArray(vao);
+        f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_vbo.Buffer());
+        verticesPerTriangle = 3; mode = GL_TRIANGLES;
+    }
+    else
+    {
+        auto & holder = edges ? m_triEdges_vaoHolder : m_triFaces_vaoHolder;
+        auto [vao, ready] = holder.GetVAO();
+        if (!ready) SetupTriVAO(vao, f, edges); else f->glBindVertexArray(vao);
+    }
+    f->glUniform1i(3, edges);
+    for (auto & c : Commands())
+        f->glDrawArraysInstancedBaseInstance( mode, static_cast<GLint>(c.first * verticesPerTriangle),
+                                              static_cast<GLsizei>(c.count * verticesPerTriangle),
+                                              static_cast<GLsizei>(c.instanceCount), c.baseInstance );
+}
 
-    static GlassWall_GLProgram program(GlassWall_GLProgram::Mode::NT);
-    assert (program.p.isLinked());
-    if (!program.p.bind()) assert(false);
+void GlassWall::Impl::DrawNonTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                          VertexPipelineEnum pipeline                     )
+{
+    if (!m_visible || Commands().empty()) return;
+    UpdateVBOs();
+
+    auto & p = GlassWall_GLProgram::Get(GlassWall_GLProgram::Mode::NT, pipeline);
+    if (!p.Bind()) assert(false);
 
     f->glUniform1f(0, MyDepth());
     f->glUniformMatrix3fv(1, 1, GL_FALSE, (projMat * m_transformation).data());
 
-    auto [vao, ready] = m_triEdges_vaoHolder.GetVAO();
-    f->glBindVertexArray(vao);
-    if (!ready) SetupTriEdgesVAO(vao, f);
-    if (!m_tri_vbo->bind()) assert(false);
-
     f->glEnable(GL_DEPTH_TEST);
     f->glEnable(GL_MULTISAMPLE);
     f->glDepthFunc(GL_LEQUAL);
     f->glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    f->glDrawArrays( GL_POINTS, 0,
-                     static_cast<GLsizei>(m_edgeColors.size()) );
+    DrawTriangles(f, pipeline, true);
     f->glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    if (!m_transparent)
-    {
-        auto [vao, ready] = m_triFaces_vaoHolder.GetVAO();
-        f->glBindVertexArray(vao);
-        if (!ready) SetupTriFacesVAO(vao, f);
-        if (!m_tri_vbo->bind()) assert(false);
-
-        f->glDrawArrays( GL_POINTS, 0,
-                         static_cast<GLsizei>(m_fillColors.size()) );
-    }
+    if (!m_transparent) DrawTriangles(f, pipeline, false);
 }
 
 
 void GlassWall::Impl::DrawTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
-                                       TransparentStrategy strategy                     )
+                                       VertexPipelineEnum pipeline, TransparentStrategy strategy )
 {
-    if (!m_visible || m_vertices.empty() || !m_transparent) return;
-    if (m_vboNeedsToBeCreated) CreateVBO();
-    if (m_vboNeedsToBeReallocated) ReallocateVBO();
+    if (!m_visible || Commands().empty() || !m_transparent) return;
+    UpdateVBOs();
 
-    QOpenGLShaderProgram * p;
-    switch (strategy)
-    {
-        case TransparentStrategy::WBOIT:
-        {
-            static GlassWall_GLProgram program(GlassWall_GLProgram::Mode::WBOIT);
-            p = &program.p;
-            break;
-        }
-        case TransparentStrategy::CODB:
-        {
-            static GlassWall_GLProgram program(GlassWall_GLProgram::Mode::CODB);
-           p = &program.p;
-            break;
-        }
-        case TransparentStrategy::Additive:
-        {
-            static GlassWall_GLProgram program(GlassWall_GLProgram::Mode::Additive);
-            p = &program.p;
-            break;
-        }
-    }
-    assert (p->isLinked());
-    if (!p->bind()) assert(false);
+    using Mode = GlassWall_GLProgram::Mode;
+    auto mode = strategy == TransparentStrategy::WBOIT    ? Mode::WBOIT
+              : strategy == TransparentStrategy::WBOITLog ? Mode::WBOITLog
+              : strategy == TransparentStrategy::CODB     ? Mode::CODB
+                                                          : Mode::Additive;
+    auto & p = GlassWall_GLProgram::Get(mode, pipeline);
+    if (!p.Bind()) assert(false);
 
     f->glUniform1f(0, MyDepth());
     f->glUniformMatrix3fv(1, 1, GL_FALSE, (projMat * m_transformation).data());
     f->glUniform1f(2, m_opacity);
 
-    auto [vao, ready] = m_triFaces_vaoHolder.GetVAO();
-    f->glBindVertexArray(vao);
-    if (!ready) SetupTriFacesVAO(vao, f);
-    if (!m_tri_vbo->bind()) assert(false);
-
     f->glEnable(GL_DEPTH_TEST);
     f->glEnable(GL_MULTISAMPLE);
     f->glDepthFunc(GL_LEQUAL);
-    f->glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_fillColors.size()));
+    DrawTriangles(f, pipeline, false);
 }
 
-void GlassWall::Impl::DrawTransparentForWBOIT   ( OpenGLFunctions * f,
-                                                  const QMatrix3x3 & projMat )
-{ DrawTransparent(f, projMat, TransparentStrategy::WBOIT); }
+void GlassWall::Impl::DrawTransparentForWBOIT   ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                                  VertexPipelineEnum pipeline                     )
+{ DrawTransparent(f, projMat, pipeline, TransparentStrategy::WBOIT); }
+
+void GlassWall::Impl::DrawTransparentForWBOITLog( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                                  VertexPipelineEnum pipeline                     )
+{ DrawTransparent(f, projMat, pipeline, TransparentStrategy::WBOITLog); }
+
+void GlassWall::Impl::DrawTransparentForCODB    ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                                  VertexPipelineEnum pipeline                     )
+{ DrawTransparent(f, projMat, pipeline, TransparentStrategy::CODB); }
 
-void GlassWall::Impl::DrawTransparentForCODB    ( OpenGLFunctions * f,
-                                                  const QMatrix3x3 & projMat)
-{ DrawTransparent(f, projMat, TransparentStrategy::CODB); }
+void GlassWall::Impl::DrawTransparentForAdditive( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                                  VertexPipelineEnum pipeline                     )
+{ DrawTransparent(f, projMat, pipeline, TransparentStrategy::Additive); }
 
-void GlassWall::Impl::DrawTransparentForAdditive( OpenGLFunctions *f,
-                                                  const QMatrix3x3 &projMat )
-{ DrawTransparent(f, projMat, TransparentStrategy::Additive); }
 
 
 
 
+std::vector<ShaderProgram *> GlassWall::Programs( VertexPipelineEnum pipeline,
+                                                 WallBatch::TransparentMode mode )
+{
+    using Mode = GlassWall_GLProgram::Mode;
+    using TransparentMode = WallBatch::TransparentMode;
+    auto transparent = mode == TransparentMode::WBOIT    ? Mode::WBOIT
+                     : mode == TransparentMode::WBOITLog ? Mode::WBOITLog
+                     : mode == TransparentMode::CODB     ? Mode::CODB
+                                                         : Mode::Additive;
+    return { &GlassWall_GLProgram::Get(Mode::NT, pipeline),
+             &GlassWall_GLProgram::Get(transparent, pipeline) };
+}
 
 GlassWall & GlassWall::MakeInstance( int depthLevel, float opacity,
                                      bool transparent, bool visible )
@@ -432,6 +558,7 @@ GlassWall & GlassWall::MakeInstance( int depthLevel, float opacity,
                                                                            )
                                                }
                                );
+    ++g_revision; ++g_geometryRevision; ++g_wallSetRevision;
     return *iter->second;
 }
 
@@ -444,37 +571,117 @@ GlassWall & GlassWall::FindInstance(int depthLevel)
 
 size_t GlassWall::CountOfInstances() { return g_gwalls.size(); }
 
-int  GlassWall::DepthLevel(       ) const { return impl->DepthLevel(); }
-void GlassWall::DepthLevel(int lvl)       { impl->DepthLevel(lvl);     }
+void GlassWall::RemoveAllInstances()
+{
+    g_gwalls.clear();
+    ++g_revision; ++g_geometryRevision; ++g_wallSetRevision;
+}
+
+uint64_t GlassWall::Revision() { return g_revision; }
+uint64_t GlassWall::GeometryRevision() { return g_geometryRevision; }
+uint64_t GlassWall::WallSetRevision() { return g_wallSetRevision; }
 
-float GlassWall::Opacity(             ) const { return impl->Opacity(); }
-void  GlassWall::Opacity(float opacity)       { impl->Opacity(opacity); }
-bool GlassWall::Transparent(                ) const { return impl->Transparent();     }
-void GlassWall::Transparent(bool transparent)       { impl->Transparent(transparent); }
-bool GlassWall::Visible(            ) const { return impl->Visible(); }
-void GlassWall::Visible(bool visible)       { impl->Visible(visible); }
+int  GlassWall::DepthLevel(       ) const { return impl->DepthLevel();           }
+void GlassWall::DepthLevel(int lvl)       { impl->DepthLevel(lvl); ++g_revision; }
+
+float GlassWall::Opacity(             ) const { return impl->Opacity();               }
+void  GlassWall::Opacity(float opacity)       { impl->Opacity(opacity); ++g_revision; }
+bool GlassWall::Transparent(                ) const { return impl->Transparent();                   }
+void GlassWall::Transparent(bool transparent)       { impl->Transparent(transparent); ++g_revision; }
+bool GlassWall::Visible(            ) const { return impl->Visible();               }
+void GlassWall::Visible(bool visible)       { impl->Visible(visible); ++g_revision; }
 
 QMatrix3x3 GlassWall::Transformation(            ) const
 { return impl->Transformation(); }
 void       GlassWall::Transformation(QMatrix3x3 t)
-{ impl->Transformation(std::move(t)); }
+{ impl->Transformation(std::move(t)); ++g_revision; }
 
 
 void GlassWall::AddTriangle( QVector2D a, QVector2D b, QVector2D c,
                              QColor edgeColor, QColor fillColor     )
 { impl->AddTriangle(a, b, c, edgeColor, fillColor); }
 
-void GlassWall::DrawNonTransparent        (OpenGLFunctions * f, const QMatrix3x3 & projMat)
-{ impl->DrawNonTransparent        (f, projMat); }
+GlassWall::ShapeId GlassWall::AddShape(const std::vector<QVector2D> & vertices)
+{ return impl->AddShape(vertices); }
+
+void GlassWall::AddShapeInstance( ShapeId shape, const QMatrix3x3 & transformation,
+                                  QColor edgeColor, QColor fillColor                )
+{ impl->AddShapeInstance(shape, transformation, edgeColor, fillColor); }
+
+size_t GlassWall::CountOfTriangles() const
+{ return impl->m_commandEnds.empty() ? 0 : impl->m_commandEnds.back(); }
+
+GlassWall::Triangle GlassWall::GetTriangle(size_t i) const
+{
+    assert(i < CountOfTriangles());
+    auto & ends = impl->m_commandEnds;
+    auto k = static_cast<size_t>(std::upper_bound(ends.cbegin(), ends.cend(), i) - ends.cbegin());
+    auto & c = impl->Commands()[k];
+    auto local = i - (k ? ends[k - 1] : 0);
+    auto & t = impl->Triangles()[c.first + local % c.count];
+    auto & inst = impl->Instances()[c.baseInstance + local / c.count];
+
+    auto vertex = [&tr = inst.transformation](const GLfloat * v)
+    { return QVector2D( tr[0] * v[0] + tr[1] * v[1] + tr[2],
+                        tr[3] * v[0] + tr[4] * v[1] + tr[5]  ); };
+    return { vertex(&t.vertices[0]), vertex(&t.vertices[2]), vertex(&t.vertices[4]),
+             inst.ownColors ? t.edgeColor : inst.edgeColor,
+             inst.ownColors ? t.fillColor : inst.fillColor                           };
+}
+
+GLfloat GlassWall::Depth() const { return impl->MyDepth(); }
+
+GlassWall::PackedArray<PackedTriangle> GlassWall::PackedTriangles() const
+{ return impl->Triangles(); }
+GlassWall::PackedArray<PackedInstance> GlassWall::PackedInstances() const
+{ return impl->Instances(); }
+GlassWall::PackedArray<DrawArraysIndirectCommand> GlassWall::DrawCommands() const
+{ return impl->Commands(); }
+GlassWall::PackedArray<GlassWall::ShapeRange> GlassWall::Shapes() const
+{ return impl->Shapes(); }
+
+void GlassWall::SetPackedGeometry( PackedArray<PackedTriangle> triangles,
+                                   PackedArray<PackedInstance> instances,
+                                   PackedArray<DrawArraysIndirectCommand> commands,
+                                   PackedArray<ShapeRange> shapes,
+                                   std::shared_ptr<const void> storage            )
+{
+    // Buffers of the wall are append-only
+    assert(   !impl->m_storage && impl->m_triangles.empty() && impl->m_instances.size() == 1
+           && impl->m_commands.empty()                                                   );
+    assert(storage);
+    ++g_revision; ++g_geometryRevision;
+    impl->m_storedTriangles = triangles;
+    impl->m_storedInstances = instances;
+    impl->m_storedCommands  = commands;
+    impl->m_storedShapes    = shapes;
+    impl->m_storage = std::move(storage);
+    impl->m_commandEnds.clear();
+    impl->m_commandEnds.reserve(commands.size());
+    size_t end = 0;
+    for (auto & c : commands)
+        impl->m_commandEnds.push_back(end += static_cast<size_t>(c.count) * c.instanceCount);
+}
+
+void GlassWall::DrawNonTransparent        ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                            VertexPipelineEnum pipeline                     )
+{ impl->DrawNonTransparent        (f, projMat, pipeline); }
+
+void GlassWall::DrawTransparentForWBOIT   ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                            VertexPipelineEnum pipeline                     )
+{ impl->DrawTransparentForWBOIT   (f, projMat, pipeline); }
 
-void GlassWall::DrawTransparentForWBOIT   (OpenGLFunctions * f, const QMatrix3x3 & projMat)
-{ impl->DrawTransparentForWBOIT   (f, projMat); }
+void GlassWall::DrawTransparentForWBOITLog( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                            VertexPipelineEnum pipeline                     )
+{ impl->DrawTransparentForWBOITLog(f, projMat, pipeline); }
 
-void GlassWall::DrawTransparentForCODB    (OpenGLFunctions * f, const QMatrix3x3 & projMat)
-{ impl->DrawTransparentForCODB    (f, projMat); }
+void GlassWall::DrawTransparentForCODB    ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                            VertexPipelineEnum pipeline                     )
+{ impl->DrawTransparentForCODB    (f, projMat, pipeline); }
 
-void GlassWall::DrawTransparentForAdditive(OpenGLFunctions * f, const QMatrix3x3 & projMat)
-{ impl->DrawTransparentForAdditive(f, projMat); }
+void GlassWall::DrawTransparentForAdditive( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                            VertexPipelineEnum pipeline                     )
+{ impl->DrawTransparentForAdditive(f, projMat, pipeline); }
 
 GlassWallIterator & GlassWallIterator::Instance() { static GlassWallIterator ins; return ins; }
 
@@ -7,12 +7,14 @@
 #include <QMatrix4x4>
 #include <QVector2D>
 #include <QColor>
-#include <QOpenGLBuffer>
 #include <optional>
+#include <memory>
 
 #include "GLDrawingFacilities.h"
+#include "WallBatch.h"
 
 class GLResourceAllocator;
+class ShaderProgram;
 
 class GlassWall
 {
@@ -35,6 +37,18 @@ public:
                                      bool transparent, bool visible );
     static GlassWall & FindInstance(int depthLevel);
     static size_t CountOfInstances();
+    // Buffers of walls are deleted in the current context, so make one current
+    static void RemoveAllInstances();
+
+    // Change on any change of any wall, so caches of the scene know when to update
+    static uint64_t Revision();         // of anything
+    static uint64_t GeometryRevision(); // of triangles or the set of walls
+    static uint64_t WallSetRevision();  // of the set of walls
+
+    // Programs of DrawNonTransparent() and of DrawTransparentFor*() of the mode; those
+    // not used yet in the share group of the current context start linking
+    static std::vector<ShaderProgram *> Programs( VertexPipelineEnum pipeline,
+                                                  WallBatch::TransparentMode mode );
 
     ~GlassWall() = default;
     GlassWall(const GlassWall & ) = delete;
@@ -55,10 +69,65 @@ public:
 
     void AddTriangle(QVector2D a, QVector2D b, QVector2D c, QColor edgeColor, QColor fillColor);
 
-    void DrawNonTransparent        (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForWBOIT   (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForCODB    (OpenGLFunctions * f, const QMatrix3x3 & projMat);
-    void DrawTransparentForAdditive(OpenGLFunctions * f, const QMatrix3x3 & projMat);
+    // Repeated geometry: a shape is a triangle list (3 vertices each) stored once,
+    // every instance draws it with its own transformation (affine, in wall coordinates)
+    // and colors by instanced draws
+    using ShapeId = size_t;
+    ShapeId AddShape(const std::vector<QVector2D> & vertices);
+    void AddShapeInstance( ShapeId shape, const QMatrix3x3 & transformation,
+                           QColor edgeColor, QColor fillColor                );
+
+    // Read-only access to the geometry for CPU-side tools, instances of shapes included.
+    // Colors are linear, as the GPU sees them
+    struct Triangle { QVector2D a, b, c; RGB16 edgeColor, fillColor; };
+    size_t CountOfTriangles() const;
+    Triangle GetTriangle(size_t i) const;
+    GLfloat Depth() const; // in [0, 1], the greater depth level, the farther
+
+    // Read-only view of an array of the geometry, valid until the wall changes
+    template<class T> class PackedArray
+    {
+    public:
+        PackedArray() = default;
+        explicit PackedArray(const T * data, size_t size) : m_data(data), m_size(size) {}
+        const T * data() const { return m_data; }
+        size_t size() const { return m_size; }
+        bool empty() const { return !m_size; }
+        const T * begin() const { return m_data; }
+        const T * end() const { return m_data + m_size; }
+        const T & operator[](size_t i) const { return m_data[i]; }
+    private:
+        const T * m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    // As GPU buffers of the wall hold them; first and baseInstance of commands
+    // index the triangles and instances of this wall
+    PackedArray<PackedTriangle> PackedTriangles() const;
+    PackedArray<PackedInstance> PackedInstances() const;
+    PackedArray<DrawArraysIndirectCommand> DrawCommands() const;
+    struct ShapeRange { GLuint first, count; }; // of triangles, by ShapeId
+    PackedArray<ShapeRange> Shapes() const;
+    // All the geometry at once in the layout above, for a wall that has none yet
+    // (scene files); commands and shapes must index the arrays given.
+    // The arrays are read in place while storage (e.g. a mapped file) keeps them alive,
+    // and copied only when the wall changes
+    void SetPackedGeometry( PackedArray<PackedTriangle> triangles,
+                            PackedArray<PackedInstance> instances,
+                            PackedArray<DrawArraysIndirectCommand> commands,
+                            PackedArray<ShapeRange> shapes,
+                            std::shared_ptr<const void> storage            );
+
+    void DrawNonTransparent        ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForWBOIT   ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForWBOITLog( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForCODB    ( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
+    void DrawTransparentForAdditive( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                     VertexPipelineEnum pipeline                     );
 
 private:
     struct Impl; std::unique_ptr<Impl> impl;
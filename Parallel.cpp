@@ -0,0 +1,123 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "Parallel.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+struct ThreadPool::Impl
+{
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> items;
+
+        bool PopBack(size_t & item)  // owner's end
+        {
+            std::lock_guard lock(mutex);
+            if (items.empty()) return false;
+            item = items.back(); items.pop_back();
+            return true;
+        }
+        bool PopFront(size_t & item) // thieves' end
+        {
+            std::lock_guard lock(mutex);
+            if (items.empty()) return false;
+            item = items.front(); items.pop_front();
+            return true;
+        }
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker
+    std::vector<std::thread> threads;           // workers 1..N-1
+
+    std::mutex mutex;
+    std::condition_variable startCV, doneCV;
+    uint64_t generation = 0; // of the current Run()
+    unsigned busyThreads = 0;
+    bool stop = false;
+    const std::function<void(size_t, unsigned)> * job = nullptr;
+
+    void Work(unsigned worker)
+    {
+        size_t item;
+        const auto n = static_cast<unsigned>(queues.size());
+        for (;;)
+        {
+            if (queues[worker]->PopBack(item)) { (*job)(item, worker); continue; }
+            bool stolen = false;
+            for (unsigned i = 1; i != n && !stolen; ++i)
+                stolen = queues[(worker + i) % n]->PopFront(item);
+            if (!stolen) return; // items are never added during Run(), so all are taken
+            (*job)(item, worker);
+        }
+    }
+
+    void ThreadMain(unsigned worker)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock lock(mutex);
+                startCV.wait(lock, [&]{ return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+            }
+            Work(worker);
+            {
+                std::lock_guard lock(mutex);
+                if (--busyThreads == 0) doneCV.notify_one();
+            }
+        }
+    }
+};
+
+ThreadPool::ThreadPool(unsigned workers) : impl(std::make_unique<Impl>())
+{
+    workers = WorkerCount(workers);
+    for (unsigned w = 0; w != workers; ++w) impl->queues.push_back(std::make_unique<Impl::Queue>());
+    impl->threads.reserve(workers - 1);
+    for (unsigned w = 1; w != workers; ++w)
+        impl->threads.emplace_back([this, w]{ impl->ThreadMain(w); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    { std::lock_guard lock(impl->mutex); impl->stop = true; }
+    impl->startCV.notify_all();
+    for (auto & t : impl->threads) t.join();
+}
+
+unsigned ThreadPool::Workers() const { return static_cast<unsigned>(impl->queues.size()); }
+
+void ThreadPool::Run(size_t count, const std::function<void(size_t, unsigned)> & f)
+{
+    if (count == 0) return;
+    const auto n = impl->queues.size();
+
+    // Contiguous chunks keep neighbouring items (e.g. tiles) on the same worker
+    for (size_t w = 0; w != n; ++w)
+    {
+        auto & q = *impl->queues[w];
+        std::lock_guard lock(q.mutex);
+        for (size_t i = count * w / n, end = count * (w + 1) / n; i != end; ++i)
+            q.items.push_back(end - 1 - (i - count * w / n)); // popped from the back
+    }
+
+    {
+        std::lock_guard lock(impl->mutex);
+        impl->job = &f;
+        impl->busyThreads = static_cast<unsigned>(impl->threads.size());
+        ++impl->generation;
+    }
+    impl->startCV.notify_all();
+
+    impl->Work(0);
+
+    std::unique_lock lock(impl->mutex);
+    impl->doneCV.wait(lock, [this]{ return impl->busyThreads == 0; });
+    impl->job = nullptr;
+}
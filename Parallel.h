@@ -0,0 +1,64 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// 0 means "as many as the hardware can run"
+inline unsigned WorkerCount(unsigned requested)
+{
+    if (requested != 0) return requested;
+    auto hc = std::thread::hardware_concurrency();
+    return hc != 0 ? hc : 1;
+}
+
+// Calls f(index, worker) for every index in [0, count) on WorkerCount(workers) threads,
+// worker is in [0, WorkerCount(workers)). Indices are handed out one by one, so
+// uneven work items are balanced. Returns when all items are done.
+template<class F>
+void ParallelFor(size_t count, unsigned workers, F && f)
+{
+    workers = WorkerCount(workers);
+    std::atomic<size_t> next{ 0 };
+    auto work = [&next, &f, count](unsigned worker)
+    { for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) f(i, worker); };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w) threads.emplace_back(work, w);
+    work(0);
+    for (auto & t : threads) t.join();
+}
+
+// Persistent worker threads for work that is repeated many times, e.g. every frame.
+// Each worker has its own queue of items and steals from the others when it's
+// empty, so items of very different cost (like tiles of a frame) are balanced.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned workers = 0); // see WorkerCount()
+    ~ThreadPool();
+    ThreadPool(const ThreadPool & ) = delete;
+    ThreadPool(      ThreadPool &&) = delete;
+    ThreadPool & operator=(const ThreadPool & ) = delete;
+    ThreadPool & operator=(      ThreadPool &&) = delete;
+
+    unsigned Workers() const;
+
+    // Calls f(index, worker) for every index in [0, count) and waits for all of them;
+    // worker is in [0, Workers()). The calling thread is worker 0.
+    // Not reentrant: f must not call Run() of the same pool.
+    void Run(size_t count, const std::function<void(size_t, unsigned)> & f);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // PARALLEL_H
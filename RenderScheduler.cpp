@@ -0,0 +1,116 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "RenderScheduler.h"
+
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QSurfaceFormat>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "GLWidget.h"
+#include "GlassWall.h"
+
+struct RenderScheduler::Impl
+{
+    std::vector<GLWidget *> views;
+    std::function<void()> prepare;
+    QTimer timer; // single shot, at the end of the display interval of the last render
+    QElapsedTimer sinceRender;
+    bool animating = false;
+    // Views repainted by the last render while animating, with their painted frames then
+    std::vector<std::pair<GLWidget *, uint64_t>> awaited;
+
+    static bool Drawable(const GLWidget * view);
+    bool FramePainted() const; // by every awaited view that can still paint it
+    void Render();
+    void FrameSwapped();
+    static int DisplayIntervalMs();
+    static int AnimationIntervalMs();
+};
+
+int RenderScheduler::Impl::DisplayIntervalMs()
+{
+    auto screen = QGuiApplication::primaryScreen();
+    auto rate = screen ? screen->refreshRate() : 0;
+    return rate > 1 ? static_cast<int>(std::lround(1000 / rate)) : 16;
+}
+
+int RenderScheduler::Impl::AnimationIntervalMs()
+{
+    return QSurfaceFormat::defaultFormat().swapInterval() == 0 ? 0 : DisplayIntervalMs();
+}
+
+bool RenderScheduler::Impl::Drawable(const GLWidget * view)
+{
+    return    view->isVisible() && view->width() > 0 && view->height() > 0
+           && !view->visibleRegion().isEmpty();
+}
+
+bool RenderScheduler::Impl::FramePainted() const
+{
+    return std::all_of( awaited.cbegin(), awaited.cend(), [](auto & a)
+                        { return !Drawable(a.first) || a.first->PaintedFrames() != a.second; } );
+}
+
+void RenderScheduler::Impl::Render()
+{
+    if (animating && !FramePainted())
+    {
+        timer.start(DisplayIntervalMs()); // FrameSwapped() comes first unless a view got hidden
+        return;
+    }
+    sinceRender.start();
+    if (prepare) prepare();
+    auto revision = GlassWall::Revision();
+    awaited.clear();
+    for (auto view : views)
+        if (Drawable(view) && (animating || view->ShownRevision() != revision))
+        {
+            view->update();
+            if (animating) awaited.emplace_back(view, view->PaintedFrames());
+        }
+    if (animating) timer.start(awaited.empty() ? AnimationIntervalMs() : DisplayIntervalMs());
+}
+
+void RenderScheduler::Impl::FrameSwapped()
+{
+    if (!animating || awaited.empty() || !FramePainted()) return;
+    awaited.clear();
+    timer.start(static_cast<int>( std::max<qint64>( 0, AnimationIntervalMs()
+                                                       - sinceRender.elapsed() ) ));
+}
+
+RenderScheduler::RenderScheduler(std::vector<GLWidget *> views) : impl(std::make_unique<Impl>())
+{
+    impl->views = std::move(views);
+    impl->timer.setSingleShot(true);
+    QObject::connect(&impl->timer, &QTimer::timeout, &impl->timer, [this]{ impl->Render(); });
+    for (auto view : impl->views)
+        QObject::connect( view, &GLWidget::frameSwapped, &impl->timer,
+                          [this]{ impl->FrameSwapped(); } );
+}
+
+RenderScheduler::~RenderScheduler() = default;
+
+void RenderScheduler::SetPrepare(std::function<void()> prepare) { impl->prepare = std::move(prepare); }
+
+void RenderScheduler::SceneChanged()
+{
+    if (impl->timer.isActive()) return; // goes to the render scheduled already
+    auto wait = impl->sinceRender.isValid()
+                ? std::max<qint64>(0, Impl::DisplayIntervalMs() - impl->sinceRender.elapsed()) : 0;
+    impl->timer.start(static_cast<int>(wait));
+}
+
+void RenderScheduler::Animate(bool on)
+{
+    impl->animating = on;
+    impl->awaited.clear();
+    if (on) SceneChanged();
+}
@@ -0,0 +1,39 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class GLWidget;
+
+// Render on demand with changes coalesced: SceneChanged() marks the scene dirty, and at most
+// once per display interval the pending changes are applied and the views that are visible,
+// not empty and not yet showing the current revision of glass walls are repainted.
+// While animating, every visible view is repainted by every render whether the scene
+// changed or not, and the next render waits till all of them painted the frame, then
+// for the rest of the display interval (none without vsync). So an animation advanced
+// by prepare shows every frame in every view, however loaded the machine is
+class RenderScheduler
+{
+public:
+    explicit RenderScheduler(std::vector<GLWidget *> views);
+    ~RenderScheduler();
+    RenderScheduler(const RenderScheduler & ) = delete;
+    RenderScheduler(      RenderScheduler &&) = delete;
+    RenderScheduler & operator=(const RenderScheduler & ) = delete;
+    RenderScheduler & operator=(      RenderScheduler &&) = delete;
+
+    // Called right before views are repainted, to apply what was deferred till then
+    void SetPrepare(std::function<void()> prepare);
+    void SceneChanged();
+    void Animate(bool on);
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // RENDERSCHEDULER_H
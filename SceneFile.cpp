@@ -0,0 +1,202 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "SceneFile.h"
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#include "GlassWall.h"
+
+// File: FileHeader, then every wall as WallHeader followed by its triangles, instances,
+// commands and shapes. All records are multiples of 4 bytes, so every array in a mapping
+// is aligned for its element type
+namespace {
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version, walls;
+};
+
+struct WallHeader
+{
+    int32_t depthLevel;
+    float opacity;
+    uint32_t flags;
+    float transformation[9]; // row-major
+    uint64_t triangles, instances, commands, shapes;
+};
+
+constexpr char g_magic[8] = { 'G', 'W', 'S', 'C', 'E', 'N', 'E', 0 };
+constexpr uint32_t g_version = 1;
+constexpr uint32_t g_transparentFlag = 1, g_visibleFlag = 2;
+
+static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(WallHeader) % 8 == 0);
+static_assert(   sizeof(PackedTriangle) % 4 == 0 && sizeof(PackedInstance) % 4 == 0
+              && sizeof(DrawArraysIndirectCommand) % 4 == 0
+              && sizeof(GlassWall::ShapeRange) % 4 == 0                           );
+
+struct LoadedWall
+{
+    WallHeader header;
+    GlassWall::PackedArray<PackedTriangle> triangles;
+    GlassWall::PackedArray<PackedInstance> instances;
+    GlassWall::PackedArray<DrawArraysIndirectCommand> commands;
+    GlassWall::PackedArray<GlassWall::ShapeRange> shapes;
+};
+
+class MappedReader
+{
+public:
+    explicit MappedReader(const uchar * data, uint64_t size) : m_data(data), m_size(size) {}
+
+    template<class T> bool Read(T & out)
+    {
+        if (m_size - m_pos < sizeof(T)) return false;
+        std::memcpy(&out, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+    // In place: the array stays in the mapping
+    template<class T> bool ReadArray(uint64_t count, GlassWall::PackedArray<T> & out)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (count > (m_size - m_pos) / sizeof(T)) return false;
+        out = GlassWall::PackedArray<T>( reinterpret_cast<const T *>(m_data + m_pos),
+                                         static_cast<size_t>(count)                   );
+        m_pos += count * sizeof(T);
+        return true;
+    }
+    bool AtEnd() const { return m_pos == m_size; }
+
+private:
+    const uchar * m_data;
+    uint64_t m_size, m_pos = 0;
+};
+
+} // namespace
+
+QString SaveSceneFile(const QString & path)
+{
+    // Walls loaded from the file may still read its mapping, so it's replaced, not truncated
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return QStringLiteral("Can't open %1: %2").arg(path, file.errorString());
+    auto write = [&file](const void * data, size_t size)
+    { return file.write(static_cast<const char *>(data), static_cast<qint64>(size))
+             == static_cast<qint64>(size);                                          };
+
+    FileHeader header{};
+    std::memcpy(header.magic, g_magic, sizeof(g_magic));
+    header.version = g_version;
+    header.walls = static_cast<uint32_t>(GlassWall::CountOfInstances());
+    bool ok = write(&header, sizeof(header));
+
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); ok && !iter.AtEnd(); ++iter)
+    {
+        auto triangles = iter->PackedTriangles();
+        auto instances = iter->PackedInstances();
+        auto commands  = iter->DrawCommands();
+        auto shapes    = iter->Shapes();
+
+        WallHeader wh{};
+        wh.depthLevel = iter->DepthLevel();
+        wh.opacity = iter->Opacity();
+        wh.flags = (iter->Transparent() ? g_transparentFlag : 0)
+                   | (iter->Visible() ? g_visibleFlag : 0);
+        auto tr = iter->Transformation();
+        for (int row = 0; row != 3; ++row)
+            for (int col = 0; col != 3; ++col) wh.transformation[3 * row + col] = tr(row, col);
+        wh.triangles = triangles.size(); wh.instances = instances.size();
+        wh.commands  = commands .size(); wh.shapes    = shapes   .size();
+
+        ok =    write(&wh, sizeof(wh))
+             && write(triangles.data(), triangles.size() * sizeof(PackedTriangle))
+             && write(instances.data(), instances.size() * sizeof(PackedInstance))
+             && write(commands .data(), commands .size() * sizeof(DrawArraysIndirectCommand))
+             && write(shapes   .data(), shapes   .size() * sizeof(GlassWall::ShapeRange));
+    }
+    if (!ok || !file.commit())
+        return QStringLiteral("Can't write %1: %2").arg(path, file.errorString());
+    return {};
+}
+
+static bool IsFinite(const float * v, size_t count)
+{
+    return std::all_of(v, v + count, [](float x){ return std::isfinite(x); });
+}
+
+// Ranges are checked, so a broken file can't make draws read past buffers, and so are
+// numbers: checks are written so that NaN fails them
+static bool IsConsistent(const LoadedWall & w)
+{
+    auto & wh = w.header;
+    if (   w.instances.empty() || !(wh.opacity >= 0 && wh.opacity <= 1)
+        || !IsFinite(wh.transformation, std::size(wh.transformation))    )
+        return false;
+    for (auto & t : w.triangles)
+        if (!IsFinite(t.vertices, std::size(t.vertices))) return false;
+    for (auto & n : w.instances)
+        if (!IsFinite(n.transformation, std::size(n.transformation))) return false;
+    for (auto & c : w.commands)
+        if (   static_cast<uint64_t>(c.first       ) + c.count         > w.triangles.size()
+            || static_cast<uint64_t>(c.baseInstance) + c.instanceCount > w.instances.size() )
+            return false;
+    for (auto & s : w.shapes)
+        if (static_cast<uint64_t>(s.first) + s.count > w.triangles.size()) return false;
+    return true;
+}
+
+QString LoadSceneFile(const QString & path)
+{
+    // Stays open and mapped while walls read their geometry from it
+    auto file = std::make_shared<QFile>(path);
+    if (!file->open(QIODevice::ReadOnly))
+        return QStringLiteral("Can't open %1: %2").arg(path, file->errorString());
+    auto data = file->size() > 0 ? file->map(0, file->size()) : nullptr;
+    if (!data) return QStringLiteral("Can't map %1: %2").arg(path, file->errorString());
+
+    MappedReader reader(data, static_cast<uint64_t>(file->size()));
+    auto broken = QStringLiteral("%1 is not a scene file or is broken").arg(path);
+    FileHeader header{};
+    if (   !reader.Read(header) || std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0
+        || header.version != g_version || header.walls > file->size() / sizeof(WallHeader) )
+        return broken;
+
+    std::vector<LoadedWall> walls(header.walls);
+    std::set<int32_t> depthLevels;
+    for (auto & w : walls)
+    {
+        auto & wh = w.header;
+        if (   !reader.Read(wh)
+            || !reader.ReadArray(wh.triangles, w.triangles)
+            || !reader.ReadArray(wh.instances, w.instances)
+            || !reader.ReadArray(wh.commands , w.commands )
+            || !reader.ReadArray(wh.shapes   , w.shapes   )
+            || !IsConsistent(w) || !depthLevels.insert(wh.depthLevel).second)
+            return broken;
+    }
+    if (!reader.AtEnd()) return broken;
+
+    GlassWall::RemoveAllInstances();
+    for (auto & w : walls)
+    {
+        auto & wh = w.header;
+        auto & wall = GlassWall::MakeInstance( wh.depthLevel, wh.opacity,
+                                               wh.flags & g_transparentFlag,
+                                               wh.flags & g_visibleFlag      );
+        wall.Transformation(QMatrix3x3(wh.transformation));
+        wall.SetPackedGeometry(w.triangles, w.instances, w.commands, w.shapes, file);
+    }
+    return {};
+}
@@ -0,0 +1,20 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <QString>
+
+// Scene files hold glass walls with their geometry in the layout of GPU buffers
+// (PackedTriangle, PackedInstance, DrawArraysIndirectCommand), so loaded walls read
+// their arrays from the mapped file in place, until they change, and buffers are filled
+// straight from the mapping. Loading only checks ranges and that numbers are finite.
+// Byte order is native: files aren't meant to move between architectures.
+
+// Both return an error message or an empty string on success
+extern QString SaveSceneFile(const QString & path); // all glass walls
+// Replaces all glass walls (see GlassWall::RemoveAllInstances()), or none on error
+extern QString LoadSceneFile(const QString & path);
+
+#endif // SCENEFILE_H
@@ -0,0 +1,1668 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "SceneRenderer.h"
+
+#include <QMatrix4x4>
+#include <QOpenGLContext>
+
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#include "GlassWall.h"
+#include "WallBatch.h"
+#include "ShaderProgram.h"
+
+struct SceneRenderer::Impl
+{
+    explicit Impl(RenderStrategyEnum s, GLsizei numOfSamples_)
+        : strategy(s), numOfSamples(numOfSamples_), formats(DefaultFormats())
+        , trs(    s == RenderStrategyEnum::WBOIT || s == RenderStrategyEnum::WBOITLog
+                  ? std::unique_ptr<RenderStrategy>(
+                        std::make_unique<WBOITRenderStrategy>(
+                            *this, s == RenderStrategyEnum::WBOITLog )
+                                                   )
+                  : s == RenderStrategyEnum::CODB
+                    ? std::unique_ptr<RenderStrategy>(
+                          std::make_unique<CODBRenderStrategy>(*this)
+                                                     )
+                    : s == RenderStrategyEnum::Additive
+                      ? std::unique_ptr<RenderStrategy>(
+                            std::make_unique<AdditiveRenderStrategy>(*this)
+                                                       )
+                      : ( assert(s == RenderStrategyEnum::AdditiveEP),
+                          std::unique_ptr<RenderStrategy>(
+                              std::make_unique<AdditiveEPRenderStrategy>(*this)
+                                                         )                      )
+             ){}
+
+    RenderStrategyEnum strategy;
+    GLsizei numOfSamples;
+    DrawPathEnum drawPath = DrawPathEnum::Batched;
+    VertexPipelineEnum vertexPipeline = VertexPipelineEnum::VertexPulling;
+    bool batched = false; // of the current frame
+    VertexPipelineEnum pipeline = VertexPipelineEnum::GeometryShader; // of the current frame
+    CompositeEnum composite = CompositeEnum::EdgeAware;
+
+    int width = 0, height = 0;
+    QMatrix3x3 projMat;
+
+    std::array<GLenum, std::size(allTargets)> formats;
+    static std::array<GLenum, std::size(allTargets)> DefaultFormats()
+    {
+        std::array<GLenum, std::size(allTargets)> ret;
+        for (auto t : allTargets) ret[static_cast<size_t>(t)] = TargetFormats(t).front();
+        return ret;
+    }
+    GLenum Format(TargetEnum target) const { return formats[static_cast<size_t>(target)]; }
+
+    int accumulationScale = 1;
+    GLsizei accumulationSamples = 1; // at scale > 1
+    // Of the accumulation targets of WBOIT(Log) and AdditiveEP
+    int Reduced(int size) const { return (size + accumulationScale - 1) / accumulationScale; }
+    GLsizei AccumulationSamples() const
+    { return accumulationScale == 1 ? numOfSamples : accumulationSamples; }
+
+    mutable GPUPassTimer passTimer;
+    struct PassScope // measures the pass till the end of the scope
+    {
+        explicit PassScope(const Impl & impl, GPUPassTimer::Pass pass) : timer(impl.passTimer)
+        { timer.Begin(pass); }
+        ~PassScope() { timer.End(); }
+        PassScope(const PassScope & ) = delete;
+        PassScope(      PassScope &&) = delete;
+        PassScope & operator=(const PassScope & ) = delete;
+        PassScope & operator=(      PassScope &&) = delete;
+    private:
+        GPUPassTimer & timer;
+    };
+
+    void RenderNonTransparent() const;
+
+    // Color and depth of the opaque walls are the same in every view of a size, so they're
+    // rendered once per revision of walls into textures shared by all contexts
+    struct OpaqueTargets { GLuint colorTexture, depthTexture; };
+    OpaqueTargets SharedOpaquePass() const;
+    mutable GLuint sharedOpaqueUsed = 0; // color texture of the current frame, if any
+    void FenceSharedOpaqueReads() const; // at the end of the frame, see SharedOpaquePass()
+    // Draws the shared color into the bound framebuffer, and the depth if withDepth
+    void CopyOpaque(OpaqueTargets opaque, bool withDepth) const;
+    void DrawTransparentWalls(WallBatch::TransparentMode mode) const;
+    // Full-screen composite into the bound framebuffer with the pixel-rate and the per-sample
+    // variants of its program (see Composite()); bindInputs binds textures and sets uniforms
+    // of the bound program. Edges are where samples of any of edgeTextures differ; if there
+    // is a tileMask (full resolution only), those past the first count in marked tiles only
+    void DrawComposite( ShaderProgram & pixelRate, ShaderProgram & perSample,
+                        const std::vector<GLuint> & edgeTextures, GLuint tileMask,
+                        const std::function<void()> & bindInputs                  ) const;
+    // Of walls, for every draw path and vertex pipeline the GL implementation can run
+    static std::vector<ShaderProgram *> WallPrograms(WallBatch::TransparentMode mode);
+
+    std::vector<ShaderProgram *> warmingUp; // by WarmUpPrograms(), till ready
+
+    // Targets of accumulation at accumulationScale > 1: depth of the nearest opaque wall
+    // in every block of pixels to test transparent walls against, and the accumulation
+    // resolved into plain textures to upsample (g_upsamplingGLSL) from
+    struct ReducedAccumulation
+    {
+        explicit ReducedAccumulation(Impl & impl_, size_t attachments)
+            : resolvedTextures(attachments), impl(impl_) {}
+
+        std::vector<GLuint> resolvedTextures; // an accumulation attachment each
+
+        void GenGLResources();
+        void DeleteGLResources();
+        // Reduced size, formats of the accumulation attachments
+        void ReallocateStorages(int w, int h, const std::vector<GLenum> & formats);
+
+        // Attaches the depth to the framebuffer and binds it, renders the depth
+        // and sets the viewport to the reduced size
+        void Prepare(GLuint framebuffer, GLuint opaqueDepth) const;
+        // Resolves the accumulation attachments of the framebuffer, restores the viewport
+        void Resolve(GLuint framebuffer) const;
+        // For g_upsamplingGLSL
+        void BindUpsampling(GLuint opaqueDepth) const;
+
+    private:
+        Impl & impl;
+        GLuint depthTexture = 0, resolveFramebuffer = 0;
+        int width = 0, height = 0;
+    };
+
+    struct RenderStrategy
+    {
+        explicit RenderStrategy(Impl & impl_) : impl(impl_) {}
+        virtual ~RenderStrategy() = default;
+
+        virtual void GenGLResources() = 0;
+        virtual void DeleteGLResources() = 0;
+        virtual void Render(GLuint defaultFBO) const = 0;
+        // Every program Render() may bind, at any accumulation scale
+        virtual std::vector<ShaderProgram *> Programs() const = 0;
+
+        virtual void ReallocateFramebufferStorages(int w, int h) = 0;
+        void ReallocateFramebufferStorages()
+        { ReallocateFramebufferStorages(impl.width, impl.height); }
+    protected:
+        Impl & impl;
+    };
+    std::unique_ptr<RenderStrategy> trs;
+
+    struct WBOITRenderStrategy : RenderStrategy
+    {
+        explicit WBOITRenderStrategy(Impl & impl_, bool logRevealage_)
+            : RenderStrategy(impl_), logRevealage(logRevealage_)
+            , reduced(impl_, logRevealage_ ? 1 : 2) {}
+
+        const bool logRevealage; // WBOITLog: no alpha texture
+        GLuint framebuffer = 0, colorTexture = 0, alphaTexture = 0;
+        GLuint tileMask = 0; // see g_tileMaskGLSL
+        ReducedAccumulation reduced;
+
+        void GenGLResources() override;
+        void DeleteGLResources() override;
+        void ReallocateFramebufferStorages(int w, int h) override;
+        void Render(GLuint defaultFBO) const override;
+        std::vector<ShaderProgram *> Programs() const override;
+
+        void PrepareToTransparentRendering() const;
+        void CleanupAfterTransparentRendering() const;
+        void ApplyTextures(OpaqueTargets opaque) const;
+    };
+
+    struct CODBRenderStrategy : RenderStrategy
+    {
+        explicit CODBRenderStrategy(Impl & impl_) : RenderStrategy(impl_) {}
+
+        void GenGLResources() override {}
+        void DeleteGLResources() override {}
+        void ReallocateFramebufferStorages(int, int) override {}
+        void Render(GLuint defaultFBO) const override;
+        std::vector<ShaderProgram *> Programs() const override;
+
+        void PrepareToTransparentRendering() const;
+        void CleanupAfterTransparentRendering() const;
+    };
+
+    struct AdditiveRenderStrategy : RenderStrategy
+    {
+        explicit AdditiveRenderStrategy(Impl & impl_) : RenderStrategy(impl_) {}
+
+        void GenGLResources() override {}
+        void DeleteGLResources() override {}
+        void ReallocateFramebufferStorages(int, int) override {}
+        void Render(GLuint defaultFBO) const override;
+        std::vector<ShaderProgram *> Programs() const override;
+
+        void PrepareToTransparentRendering() const;
+        void CleanupAfterTransparentRendering() const;
+    };
+
+    struct AdditiveEPRenderStrategy : RenderStrategy // exposition in posprocessing
+    {
+        explicit AdditiveEPRenderStrategy(Impl & impl_)
+            : RenderStrategy(impl_), reduced(impl_, 1) {}
+
+        GLuint framebuffer = 0, colorTexture = 0;
+        ReducedAccumulation reduced;
+
+        void GenGLResources() override;
+        void DeleteGLResources() override;
+        void ReallocateFramebufferStorages(int w, int h) override;
+        void Render(GLuint defaultFBO) const override;
+        std::vector<ShaderProgram *> Programs() const override;
+
+        void PrepareToTransparentRendering() const;
+        void CleanupAfterTransparentRendering() const;
+        void ApplyTextures(OpaqueTargets opaque) const;
+    };
+};
+
+const char * SceneRenderer::StrategyName(RenderStrategyEnum strategy)
+{
+    switch (strategy)
+    {
+    case RenderStrategyEnum::WBOIT     : return "WBOIT";
+    case RenderStrategyEnum::WBOITLog  : return "WBOITLog";
+    case RenderStrategyEnum::CODB      : return "CODB";
+    case RenderStrategyEnum::Additive  : return "Additive";
+    case RenderStrategyEnum::AdditiveEP: return "AdditiveEP";
+    }
+    assert(false); return "";
+}
+
+SceneRenderer::SceneRenderer(RenderStrategyEnum strategy, GLsizei numOfSamples)
+    : impl(std::make_unique<Impl>(strategy, numOfSamples)) {}
+
+SceneRenderer::~SceneRenderer() = default;
+
+const char * SceneRenderer::DrawPathName(DrawPathEnum path)
+{
+    switch (path)
+    {
+    case DrawPathEnum::PerWall: return "PerWall";
+    case DrawPathEnum::Batched: return "Batched";
+    }
+    assert(false); return "";
+}
+
+const char * SceneRenderer::VertexPipelineName(VertexPipelineEnum pipeline)
+{
+    switch (pipeline)
+    {
+    case VertexPipelineEnum::GeometryShader: return "GeometryShader";
+    case VertexPipelineEnum::VertexPulling : return "VertexPulling";
+    }
+    assert(false); return "";
+}
+
+const char * SceneRenderer::CompositeName(CompositeEnum composite)
+{
+    switch (composite)
+    {
+    case CompositeEnum::PerSample: return "PerSample";
+    case CompositeEnum::EdgeAware: return "EdgeAware";
+    }
+    assert(false); return "";
+}
+
+const char * SceneRenderer::TargetName(TargetEnum target)
+{
+    switch (target)
+    {
+    case TargetEnum::OpaqueColor    : return "OpaqueColor";
+    case TargetEnum::WBOITColor     : return "WBOITColor";
+    case TargetEnum::WBOITRevealage : return "WBOITRevealage";
+    case TargetEnum::AdditiveEPColor: return "AdditiveEPColor";
+    }
+    assert(false); return "";
+}
+
+std::vector<SceneRenderer::TargetEnum> SceneRenderer::StrategyTargets(RenderStrategyEnum strategy)
+{
+    switch (strategy)
+    {
+    case RenderStrategyEnum::WBOIT:
+        return { TargetEnum::OpaqueColor, TargetEnum::WBOITColor, TargetEnum::WBOITRevealage };
+    case RenderStrategyEnum::WBOITLog  : return { TargetEnum::OpaqueColor, TargetEnum::WBOITColor };
+    case RenderStrategyEnum::CODB      :
+    case RenderStrategyEnum::Additive  : return { TargetEnum::OpaqueColor };
+    case RenderStrategyEnum::AdditiveEP:
+        return { TargetEnum::OpaqueColor, TargetEnum::AdditiveEPColor };
+    }
+    assert(false); return {};
+}
+
+const std::vector<GLenum> & SceneRenderer::TargetFormats(TargetEnum target)
+{
+    // Colors need 3 channels; WBOIT keeps the sum of weights in alpha
+    static const std::vector<GLenum> opaqueColor = {
+        GL_RGB10_A2, GL_RGBA16F, GL_R11F_G11F_B10F, GL_RGBA8, GL_RGB16F, GL_RGBA32F
+    };
+    static const std::vector<GLenum> wboitColor = { GL_RGBA16F, GL_RGBA8, GL_RGBA32F };
+    static const std::vector<GLenum> wboitRevealage = { GL_R16, GL_R8, GL_R16F, GL_RG16F, GL_R32F };
+    static const std::vector<GLenum> additiveEPColor = {
+        GL_RGB16F, GL_R11F_G11F_B10F, GL_RGBA8, GL_RGBA16F, GL_RGBA32F
+    };
+    switch (target)
+    {
+    case TargetEnum::OpaqueColor    : return opaqueColor;
+    case TargetEnum::WBOITColor     : return wboitColor;
+    case TargetEnum::WBOITRevealage : return wboitRevealage;
+    case TargetEnum::AdditiveEPColor: return additiveEPColor;
+    }
+    assert(false); return opaqueColor;
+}
+
+GLenum SceneRenderer::ReferenceFormat(TargetEnum target)
+{ return target == TargetEnum::WBOITRevealage ? GL_R32F : GL_RGBA32F; }
+
+struct FormatInfo { GLenum format; const char * name; int bytes; };
+static constexpr FormatInfo g_formats[] = {
+    { GL_RGBA32F       , "RGBA32F"       , 16 },
+    { GL_RGBA16F       , "RGBA16F"       ,  8 },
+    { GL_RGB16F        , "RGB16F"        ,  6 },
+    { GL_R11F_G11F_B10F, "R11F_G11F_B10F",  4 },
+    { GL_RGB10_A2      , "RGB10_A2"      ,  4 },
+    { GL_RGBA8         , "RGBA8"         ,  4 },
+    { GL_RG16F         , "RG16F"         ,  4 },
+    { GL_R32F          , "R32F"          ,  4 },
+    { GL_R16F          , "R16F"          ,  2 },
+    { GL_R16           , "R16"           ,  2 },
+    { GL_R8            , "R8"            ,  1 }
+};
+
+static const FormatInfo & FindFormat(GLenum format)
+{
+    auto it = std::find_if( std::begin(g_formats), std::end(g_formats),
+                            [format](const FormatInfo & fi){ return fi.format == format; } );
+    assert(it != std::end(g_formats));
+    return *it;
+}
+
+const char * SceneRenderer::FormatName(GLenum format) { return FindFormat(format).name; }
+int SceneRenderer::FormatBytes(GLenum format) { return FindFormat(format).bytes; }
+
+SceneRenderer::RenderStrategyEnum SceneRenderer::Strategy() const { return impl->strategy; }
+GLsizei SceneRenderer::NumOfSamples() const { return impl->numOfSamples; }
+SceneRenderer::DrawPathEnum SceneRenderer::DrawPath() const { return impl->drawPath; }
+void SceneRenderer::DrawPath(DrawPathEnum path) { impl->drawPath = path; }
+VertexPipelineEnum SceneRenderer::VertexPipeline() const
+{ return impl->vertexPipeline; }
+void SceneRenderer::VertexPipeline(VertexPipelineEnum pipeline) { impl->vertexPipeline = pipeline; }
+SceneRenderer::CompositeEnum SceneRenderer::Composite() const { return impl->composite; }
+void SceneRenderer::Composite(CompositeEnum composite) { impl->composite = composite; }
+
+int SceneRenderer::AccumulationScale() const { return impl->accumulationScale; }
+GLsizei SceneRenderer::AccumulationSamples() const { return impl->AccumulationSamples(); }
+void SceneRenderer::Accumulation(int scale, GLsizei samples)
+{
+    assert(   std::find(std::begin(allAccumulationScales), std::end(allAccumulationScales), scale)
+           != std::end(allAccumulationScales) && samples >= 1                              );
+    impl->accumulationScale = scale; impl->accumulationSamples = samples;
+    impl->trs->ReallocateFramebufferStorages();
+}
+
+GLenum SceneRenderer::TargetFormat(TargetEnum target) const { return impl->Format(target); }
+void SceneRenderer::TargetFormat(TargetEnum target, GLenum format)
+{
+    auto & formats = TargetFormats(target);
+    assert(std::find(formats.begin(), formats.end(), format) != formats.end());
+    impl->formats[static_cast<size_t>(target)] = format;
+    impl->trs->ReallocateFramebufferStorages();
+}
+
+double SceneRenderer::BytesPerPixel() const
+{
+    static constexpr int depthBytes = 4; // GL_DEPTH_COMPONENT24 is padded
+    auto bytes = [this](TargetEnum t){ return FormatBytes(impl->Format(t)); };
+    bool full = impl->accumulationScale == 1;
+
+    // Accumulation targets, then their reduced depth and resolved copies
+    int accumulation = 0;
+    for (auto t : StrategyTargets(impl->strategy))
+        if (t != TargetEnum::OpaqueColor) accumulation += bytes(t);
+    double reduced = full ? 0 : accumulation + depthBytes * impl->AccumulationSamples();
+    accumulation *= impl->AccumulationSamples();
+
+    double scaleSq = impl->accumulationScale * impl->accumulationScale;
+    return (bytes(TargetEnum::OpaqueColor) + depthBytes) * impl->numOfSamples
+           + (accumulation + reduced) / scaleSq;
+}
+
+void SceneRenderer::GenGLResources()
+{ impl->trs->GenGLResources(); impl->passTimer.GenGLResources(); }
+void SceneRenderer::DeleteGLResources()
+{ impl->trs->DeleteGLResources(); impl->passTimer.DeleteGLResources(); }
+
+QMatrix3x3 SceneRenderer::ProjectionMatrix(int width, int height)
+{
+    float aspect = static_cast<float>(width) / height;
+
+    float halfHeight = 1.0f, halfWidth = 1.0f;
+    if (width > height) halfWidth  *= aspect;
+    else                halfHeight /= aspect;
+
+    QMatrix3x3 ret;
+    ret.data()[0] = 1 / halfWidth ;
+    ret.data()[4] = 1 / halfHeight;
+    return ret;
+}
+
+void SceneRenderer::Resize(int width, int height)
+{
+    auto f = GLFunctions();
+    impl->width = width; impl->height = height;
+    f->glViewport(0, 0, width, height);
+
+    impl->projMat = ProjectionMatrix(width, height);
+
+    impl->trs->ReallocateFramebufferStorages();
+}
+
+void SceneRenderer::Render(GLuint defaultFBO) const
+{
+    FlushDeletedVAOs();
+
+    static const bool batchSupported = WallBatch::IsSupported();
+    impl->batched = impl->drawPath == DrawPathEnum::Batched && batchSupported;
+    static const bool pullingSupported = HasVertexShaderStorageBlocks();
+    impl->pipeline = pullingSupported ? impl->vertexPipeline : VertexPipelineEnum::GeometryShader;
+    if (impl->batched) WallBatch::Instance().Update();
+
+    impl->passTimer.BeginFrame();
+    impl->sharedOpaqueUsed = 0;
+    impl->trs->Render(defaultFBO);
+    impl->FenceSharedOpaqueReads();
+    impl->passTimer.EndFrame();
+}
+
+void SceneRenderer::WarmUpPrograms() { impl->warmingUp = impl->trs->Programs(); }
+
+bool SceneRenderer::ProgramsReady()
+{
+    auto & w = impl->warmingUp;
+    w.erase( std::remove_if(w.begin(), w.end(), [](ShaderProgram * p){ return p->Ready(); }),
+             w.end()                                                                        );
+    return w.empty();
+}
+
+const GPUPassTimer & SceneRenderer::PassTimer() const { return impl->passTimer; }
+bool SceneRenderer::CollectPassTimings() { return impl->passTimer.Collect(); }
+
+
+
+
+
+void SceneRenderer::Impl::RenderNonTransparent() const
+{
+    auto f = GLFunctions();
+
+    static constexpr GLfloat clearColor[3] = { 0.0f, 0.0f, 0.0f };
+    static constexpr GLfloat clearDepth = 1.0f;
+
+    f->glClearBufferfv(GL_COLOR, 0,  clearColor);
+    f->glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+    if (batched) { WallBatch::Instance().DrawNonTransparent(f, projMat, pipeline); return; }
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); !iter.AtEnd(); ++iter) iter->DrawNonTransparent(f, projMat, pipeline);
+}
+
+// Textures and fences are shared by all contexts, framebuffers aren't,
+// so the one to render the pass into lives for a pass only
+struct SharedOpaqueEntry
+{
+    int width = 0, height = 0;
+    GLsizei numOfSamples = 0;
+    GLenum colorFormat = 0;
+    GLuint colorTexture = 0, depthTexture = 0;
+    std::optional<uint64_t> revision; // of walls rendered
+    GLsync fence = nullptr;           // signalled when they are
+    // By slot index of contexts that read the textures since: signalled when the last
+    // frame reading them there is done, so rendering them again waits for all
+    std::vector<std::pair<uint32_t, GLsync>> readFences;
+    uint64_t lastUse = 0;
+
+    void Delete(OpenGLFunctions * f) const
+    {
+        f->glDeleteTextures(1, &colorTexture);
+        f->glDeleteTextures(1, &depthTexture);
+        if (fence) f->glDeleteSync(fence);
+        for (auto & r : readFences) f->glDeleteSync(r.second);
+    }
+};
+
+// One per share group like the programs, see GLProgram(), so the textures die with it.
+// They are deleted by dtor if a context of the group is current, otherwise they live
+// as long as the share group
+struct SharedOpaqueGLResources
+{
+    static constexpr size_t maxEntries = 4; // sizes and formats of views at once
+    std::vector<SharedOpaqueEntry> entries;
+    uint64_t uses = 0;
+    QOpenGLContextGroup * group = QOpenGLContext::currentContext()->shareGroup();
+
+    explicit SharedOpaqueGLResources() = default;
+    ~SharedOpaqueGLResources()
+    {
+        auto current = QOpenGLContext::currentContext();
+        if (!current || current->shareGroup() != group) return;
+        auto f = GLFunctions();
+        for (auto & e : entries) e.Delete(f);
+    }
+    SharedOpaqueGLResources(const SharedOpaqueGLResources & ) = delete;
+    SharedOpaqueGLResources(      SharedOpaqueGLResources &&) = delete;
+    SharedOpaqueGLResources & operator=(const SharedOpaqueGLResources & ) = delete;
+    SharedOpaqueGLResources & operator=(      SharedOpaqueGLResources &&) = delete;
+};
+
+SceneRenderer::Impl::OpaqueTargets SceneRenderer::Impl::SharedOpaquePass() const
+{
+    auto f = GLFunctions();
+    auto & res = GLProgram<SharedOpaqueGLResources>(0);
+    auto & entries = res.entries;
+
+    int w = std::max(width, 1), h = std::max(height, 1);
+    auto it = std::find_if( entries.begin(), entries.end(),
+                            [&](const SharedOpaqueEntry & e)
+                            { return    e.width == w && e.height == h
+                                     && e.numOfSamples == numOfSamples
+                                     && e.colorFormat == Format(TargetEnum::OpaqueColor); } );
+    if (it == entries.end())
+    {
+        if (entries.size() == SharedOpaqueGLResources::maxEntries)
+        {
+            auto lru = std::min_element( entries.begin(), entries.end(),
+                                         []( const SharedOpaqueEntry & a,
+                                             const SharedOpaqueEntry & b )
+                                         { return a.lastUse < b.lastUse; } );
+            lru->Delete(f);
+            entries.erase(lru);
+        }
+
+        SharedOpaqueEntry e;
+        e.width = w; e.height = h; e.numOfSamples = numOfSamples;
+        e.colorFormat = Format(TargetEnum::OpaqueColor);
+        f->glGenTextures(1, &e.colorTexture);
+        f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, e.colorTexture);
+        f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, numOfSamples,
+                                    e.colorFormat, w, h, GL_TRUE           );
+        f->glGenTextures(1, &e.depthTexture);
+        f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, e.depthTexture);
+        f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, numOfSamples,
+                                    GL_DEPTH_COMPONENT24, w, h, GL_TRUE    );
+        entries.push_back(e);
+        it = std::prev(entries.end());
+    }
+    it->lastUse = ++res.uses;
+    sharedOpaqueUsed = it->colorTexture;
+
+    if (it->revision == GlassWall::Revision())
+    {
+        // Another context may still be rendering it
+        f->glWaitSync(it->fence, 0, GL_TIMEOUT_IGNORED);
+        return { it->colorTexture, it->depthTexture };
+    }
+
+    // Other contexts may still be reading the previous revision
+    for (auto & r : it->readFences)
+    {
+        f->glWaitSync(r.second, 0, GL_TIMEOUT_IGNORED);
+        f->glDeleteSync(r.second);
+    }
+    it->readFences.clear();
+
+    GLuint framebuffer = 0;
+    f->glGenFramebuffers(1, &framebuffer);
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D_MULTISAMPLE, it->colorTexture, 0 );
+    f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D_MULTISAMPLE, it->depthTexture, 0 );
+    RenderNonTransparent();
+    f->glDeleteFramebuffers(1, &framebuffer);
+
+    if (it->fence) f->glDeleteSync(it->fence);
+    it->fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    f->glFlush(); // so other contexts waiting for the fence don't wait forever
+    it->revision = GlassWall::Revision();
+    return { it->colorTexture, it->depthTexture };
+}
+
+void SceneRenderer::Impl::FenceSharedOpaqueReads() const
+{
+    if (!sharedOpaqueUsed) return;
+    auto & entries = GLProgram<SharedOpaqueGLResources>(0).entries;
+    auto it = std::find_if( entries.begin(), entries.end(), [this](const SharedOpaqueEntry & e)
+                            { return e.colorTexture == sharedOpaqueUsed; } );
+    if (it == entries.end()) { assert(false); return; }
+
+    // A fence of a later frame of the context is signalled after those of earlier ones
+    auto f = GLFunctions();
+    auto slot = CurrentGLContextSlot().index;
+    auto r = std::find_if( it->readFences.begin(), it->readFences.end(),
+                           [slot](auto & e){ return e.first == slot; } );
+    if (r == it->readFences.end()) r = it->readFences.insert(r, { slot, nullptr });
+    else f->glDeleteSync(r->second);
+    r->second = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    f->glFlush(); // so a context waiting for the fence doesn't wait forever
+}
+
+// The full screen quad of composite passes
+static const char * const g_fullScreenVertexGLSL =
+        "#version 450 core                                            \n"
+        "const vec2 p[4] = vec2[4](                                   \n"
+        "     vec2(-1, -1), vec2( 1, -1), vec2( 1,  1), vec2(-1,  1)  \n"
+        "                         );                                  \n"
+        "void main() { gl_Position = vec4(p[gl_VertexID], 0, 1); }    \n";
+
+// One per share group like GlassWall_GLProgram, see GLProgram()
+struct CopyOpaqueGLResources {
+    ShaderProgram program;
+
+    explicit CopyOpaqueGLResources()
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTexture;              \n"
+                    "layout (location = 1) uniform  sampler2DMS depthTexture;              \n"
+                    "                                                                      \n"
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    outColor     = texelFetch(colorTexture, upos, gl_SampleID);       \n"
+                    "    gl_FragDepth = texelFetch(depthTexture, upos, gl_SampleID).r;     \n"
+                    "}                                                                     \n"
+                    );
+        program.Link();
+    }
+};
+
+void SceneRenderer::Impl::CopyOpaque(OpaqueTargets opaque, bool withDepth) const
+{
+    auto f = GLFunctions();
+    auto & res = GLProgram<CopyOpaqueGLResources>(0);
+
+    if (!res.program.Bind()) assert(false);
+
+    f->glBindTextureUnit(0, opaque.colorTexture); f->glUniform1i(0, 0);
+    f->glBindTextureUnit(1, opaque.depthTexture); f->glUniform1i(1, 1);
+
+    f->glEnable(GL_MULTISAMPLE);
+    if (withDepth)
+    { f->glEnable(GL_DEPTH_TEST); f->glDepthFunc(GL_ALWAYS); f->glDepthMask(GL_TRUE); }
+    else f->glDisable(GL_DEPTH_TEST); // no depth writes either
+    f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+// Nearest depth of every block of scale x scale pixels, all of their samples
+struct DownsampleDepthGLResources {
+    ShaderProgram program;
+
+    explicit DownsampleDepthGLResources()
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    "#version 450 core                                                     \n"
+                    "layout (location = 0) uniform  sampler2DMS depthTexture;              \n"
+                    "layout (location = 1) uniform  int scale;                             \n"
+                    "                                                                      \n"
+                    "void main() {                                                         \n"
+                    "    ivec2 first = ivec2(gl_FragCoord.xy) * scale;                     \n"
+                    "    ivec2 last  = min(first + scale, textureSize(depthTexture)) - 1;  \n"
+                    "    int samples = textureSamples(depthTexture);                       \n"
+                    "                                                                      \n"
+                    "    float nearest = 1;                                                \n"
+                    "    for (int y = first.y; y <= last.y; ++y)                           \n"
+                    "        for (int x = first.x; x <= last.x; ++x)                       \n"
+                    "            for (int i = 0; i != samples; ++i)                        \n"
+                    "                nearest = min( nearest,                               \n"
+                    "                               texelFetch(depthTexture, ivec2(x, y), i).r );\n"
+                    "    gl_FragDepth = nearest;                                           \n"
+                    "}                                                                     \n"
+                    );
+        program.Link();
+    }
+};
+
+// Composite fragment shaders fetch inputs of full resolution at SAMPLE: gl_SampleID shades
+// every sample, 0 shades a pixel once, which is enough where its samples are the same
+static QByteArray CompositeShader(QByteArray source, bool perSample)
+{
+    auto afterVersion = source.indexOf('\n') + 1;
+    return source.insert( afterVersion, perSample ? "#define SAMPLE gl_SampleID\n"
+                                                  : "#define SAMPLE 0\n"          );
+}
+
+// Transparent walls of WBOIT(Log) mark the tiles of 16x16 (g_tileSize) accumulation
+// pixels they draw to in an R8UI image, see GlassWall_GLProgram. Composite shaders
+// including this take the opaque color as it is in the tiles left unmarked
+static constexpr int g_tileSize = 16;
+static const char * const g_tileMaskGLSL =
+        "layout (location = 7) uniform  usampler2D tileMask;                           \n"
+        "                                                                              \n"
+        "bool Transparent(ivec2 texel) { // of accumulation                            \n"
+        "    ivec2 tile = min(max(texel, ivec2(0)) / 16, textureSize(tileMask, 0) - 1);\n"
+        "    return texelFetch(tileMask, tile, 0).r != 0;                              \n"
+        "}                                                                             \n";
+
+// Fragments of pixels whose samples differ in any of the textures pass, others are
+// discarded; it runs once per pixel, as it reads no gl_SampleID
+struct MarkEdgesGLResources {
+    ShaderProgram program;
+
+    explicit MarkEdgesGLResources()
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "layout (location = 0) uniform  sampler2DMS textures[3];               \n"
+                    "layout (location = 3) uniform  int count;                             \n"
+                    "layout (location = 4) uniform  bool tiled; // see DrawComposite()     \n"
+                              ) + g_tileMaskGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    int n = tiled && !Transparent(upos) ? 1 : count;                  \n"
+                    "    for (int t = 0; t != n; ++t) {                                    \n"
+                    "        vec4 first = texelFetch(textures[t], upos, 0);                \n"
+                    "        for (int i = 1; i < textureSamples(textures[t]); ++i)         \n"
+                    "            if (texelFetch(textures[t], upos, i) != first) return;    \n"
+                    "    }                                                                 \n"
+                    "    discard;                                                          \n"
+                    "}                                                                     \n"
+                    );
+        program.Link();
+    }
+};
+
+void SceneRenderer::Impl::DrawComposite(
+        ShaderProgram & pixelRate, ShaderProgram & perSample,
+        const std::vector<GLuint> & edgeTextures, GLuint tileMask,
+        const std::function<void()> & bindInputs                  ) const
+{
+    auto f = GLFunctions();
+    f->glEnable(GL_MULTISAMPLE); f->glDisable(GL_DEPTH_TEST);
+    if (composite == CompositeEnum::PerSample || numOfSamples == 1)
+    {
+        if (!perSample.Bind()) assert(false);
+        bindInputs();
+        f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        return;
+    }
+
+    // Units past those of the composite programs
+    static constexpr GLint firstUnit = 8;
+    assert(edgeTextures.size() <= 3);
+    auto & marking = GLProgram<MarkEdgesGLResources>(0).program;
+    if (!marking.Bind()) assert(false);
+    for (GLint i = 0; i != static_cast<GLint>(edgeTextures.size()); ++i)
+    {
+        f->glBindTextureUnit(static_cast<GLuint>(firstUnit + i), edgeTextures[i]);
+        f->glUniform1i(i, firstUnit + i);
+    }
+    f->glUniform1i(3, static_cast<GLint>(edgeTextures.size()));
+    f->glUniform1i(4, tileMask != 0);
+    if (tileMask) { f->glBindTextureUnit(7, tileMask); f->glUniform1i(7, 7); }
+
+    static constexpr GLint clearStencil = 0;
+    f->glClearBufferiv(GL_STENCIL, 0, &clearStencil);
+    f->glEnable(GL_STENCIL_TEST);
+    f->glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    f->glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    f->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    f->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    f->glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+    f->glStencilFunc(GL_EQUAL, 0, 0xFF);
+    if (!pixelRate.Bind()) assert(false);
+    bindInputs();
+    f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    f->glStencilFunc(GL_EQUAL, 1, 0xFF);
+    if (!perSample.Bind()) assert(false);
+    bindInputs();
+    f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    f->glDisable(GL_STENCIL_TEST);
+}
+
+// Included by composite shaders of reduced accumulation. The 4 texels nearest to the sample
+// are weighted bilinearly and by the similarity of their depth to that of the sample: with the
+// nearest depth of a block, texels of surfaces behind an opaque edge lose to ones on its side
+static const char * const g_upsamplingGLSL =
+        "layout (location = 4) uniform  sampler2DMS depthTexture;    // opaque walls   \n"
+        "layout (location = 5) uniform  sampler2DMS reducedDepthTexture;               \n"
+        "layout (location = 6) uniform  int scale;                                     \n"
+        "                                                                              \n"
+        "void Upsampling(ivec2 upos, out ivec2 texels[4], out float weights[4]) {      \n"
+        "    float depth = texelFetch(depthTexture, upos, SAMPLE).r;                   \n"
+        "    vec2 pos = (vec2(upos) + 0.5) / scale - 0.5;                              \n"
+        "    ivec2 base = ivec2(floor(pos));                                           \n"
+        "    vec2 t = pos - vec2(base);                                                \n"
+        "    ivec2 maxTexel = textureSize(reducedDepthTexture) - 1;                    \n"
+        "                                                                              \n"
+        "    float sum = 0;                                                            \n"
+        "    for (int i = 0; i != 4; ++i) {                                            \n"
+        "        ivec2 o = ivec2(i & 1, i >> 1);                                       \n"
+        "        texels[i] = clamp(base + o, ivec2(0), maxTexel);                      \n"
+        "        float bilinear = mix(1 - t.x, t.x, o.x) * mix(1 - t.y, t.y, o.y);     \n"
+        "        float d = texelFetch(reducedDepthTexture, texels[i], 0).r;            \n"
+        "        weights[i] = bilinear / (1e-4 + abs(depth - d));                      \n"
+        "        sum += weights[i];                                                    \n"
+        "    }                                                                         \n"
+        "    for (int i = 0; i != 4; ++i) weights[i] /= sum;                           \n"
+        "}                                                                             \n";
+
+// Included after g_upsamplingGLSL and g_tileMaskGLSL: if any of the texels Upsampling()
+// weighs is in a marked tile, without fetching the depth it needs for the weights
+static const char * const g_reducedTileMaskGLSL =
+        "bool TransparentNear(ivec2 upos) {                                            \n"
+        "    ivec2 base = ivec2(floor((vec2(upos) + 0.5) / scale - 0.5));              \n"
+        "    return    Transparent(base              ) || Transparent(base + ivec2(1, 0))\n"
+        "           || Transparent(base + ivec2(0, 1)) || Transparent(base + ivec2(1, 1));\n"
+        "}                                                                             \n";
+
+void SceneRenderer::Impl::ReducedAccumulation::GenGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glGenTextures    (1, &depthTexture      );
+    f->glGenFramebuffers(1, &resolveFramebuffer);
+    f->glGenTextures(static_cast<GLsizei>(resolvedTextures.size()), resolvedTextures.data());
+    // Textures are attached once they exist, see ReallocateStorages()
+}
+
+void SceneRenderer::Impl::ReducedAccumulation::DeleteGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glDeleteTextures    (1, &depthTexture);
+    f->glDeleteFramebuffers(1, &resolveFramebuffer);
+    f->glDeleteTextures(static_cast<GLsizei>(resolvedTextures.size()), resolvedTextures.data());
+}
+
+void SceneRenderer::Impl::ReducedAccumulation::ReallocateStorages(
+        int w, int h, const std::vector<GLenum> & formats )
+{
+    assert(formats.size() == resolvedTextures.size());
+    auto f = GLFunctions();
+    width = w; height = h;
+
+    f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTexture);
+    f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, impl.AccumulationSamples(),
+                                GL_DEPTH_COMPONENT24, w, h, GL_TRUE                   );
+    for (size_t i = 0; i != resolvedTextures.size(); ++i)
+    {
+        f->glBindTexture(GL_TEXTURE_2D, resolvedTextures[i]);
+        f->glTexImage2D( GL_TEXTURE_2D, 0, static_cast<GLint>(formats[i]), w, h, 0,
+                         GL_RGBA, GL_FLOAT, nullptr                                 );
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        f->glNamedFramebufferTexture( resolveFramebuffer,
+                                      GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i),
+                                      resolvedTextures[i], 0                         );
+    }
+}
+
+void SceneRenderer::Impl::ReducedAccumulation::Prepare(GLuint framebuffer, GLuint opaqueDepth) const
+{
+    auto f = GLFunctions();
+    auto & res = GLProgram<DownsampleDepthGLResources>(0);
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                               GL_TEXTURE_2D_MULTISAMPLE, depthTexture, 0 );
+    f->glViewport(0, 0, width, height);
+
+    if (!res.program.Bind()) assert(false);
+    f->glBindTextureUnit(0, opaqueDepth); f->glUniform1i(0, 0);
+    f->glUniform1i(1, impl.accumulationScale);
+
+    f->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    f->glEnable(GL_DEPTH_TEST); f->glDepthFunc(GL_ALWAYS); f->glDepthMask(GL_TRUE);
+    f->glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    f->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void SceneRenderer::Impl::ReducedAccumulation::Resolve(GLuint framebuffer) const
+{
+    auto f = GLFunctions();
+    for (size_t i = 0; i != resolvedTextures.size(); ++i)
+    {
+        auto attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+        f->glNamedFramebufferReadBuffer(framebuffer       , attachment);
+        f->glNamedFramebufferDrawBuffer(resolveFramebuffer, attachment);
+        f->glBlitNamedFramebuffer( framebuffer, resolveFramebuffer, 0, 0, width, height,
+                                   0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+    }
+    f->glViewport(0, 0, impl.width, impl.height);
+}
+
+void SceneRenderer::Impl::ReducedAccumulation::BindUpsampling(GLuint opaqueDepth) const
+{
+    auto f = GLFunctions();
+    f->glBindTextureUnit(4, opaqueDepth ); f->glUniform1i(4, 4);
+    f->glBindTextureUnit(5, depthTexture); f->glUniform1i(5, 5);
+    f->glUniform1i(6, impl.accumulationScale);
+}
+
+void SceneRenderer::Impl::DrawTransparentWalls(WallBatch::TransparentMode mode) const
+{
+    auto f = GLFunctions();
+    if (batched) { WallBatch::Instance().DrawTransparent(f, projMat, pipeline, mode); return; }
+
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); !iter.AtEnd(); ++iter)
+        switch (mode)
+        {
+        case WallBatch::TransparentMode::WBOIT:
+            iter->DrawTransparentForWBOIT   (f, projMat, pipeline); break;
+        case WallBatch::TransparentMode::WBOITLog:
+            iter->DrawTransparentForWBOITLog(f, projMat, pipeline); break;
+        case WallBatch::TransparentMode::CODB:
+            iter->DrawTransparentForCODB    (f, projMat, pipeline); break;
+        case WallBatch::TransparentMode::Additive:
+            iter->DrawTransparentForAdditive(f, projMat, pipeline); break;
+        }
+}
+
+std::vector<ShaderProgram *> SceneRenderer::Impl::WallPrograms(WallBatch::TransparentMode mode)
+{
+    std::vector<ShaderProgram *> ret;
+    auto append = [&ret](const std::vector<ShaderProgram *> & programs)
+    { ret.insert(ret.end(), programs.begin(), programs.end()); };
+    for (auto pipeline : allVertexPipelines)
+    {
+        if (pipeline == VertexPipelineEnum::VertexPulling && !HasVertexShaderStorageBlocks())
+            continue;
+        append(GlassWall::Programs(pipeline, mode));
+        if (WallBatch::IsSupported()) append(WallBatch::Programs(pipeline, mode));
+    }
+    return ret;
+}
+
+
+
+
+void SceneRenderer::Impl::WBOITRenderStrategy::GenGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glGenFramebuffers(1, &framebuffer );
+    f->glGenTextures    (1, &colorTexture);
+    if (!logRevealage) f->glGenTextures(1, &alphaTexture);
+    f->glGenTextures    (1, &tileMask    );
+    reduced.GenGLResources();
+
+    ReallocateFramebufferStorages(1, 1);
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D_MULTISAMPLE, colorTexture, 0 );
+    if (!logRevealage)
+        f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                                   GL_TEXTURE_2D_MULTISAMPLE, alphaTexture, 0 );
+    GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    // Depth is attached at rendering, see SharedOpaquePass()
+    f->glDrawBuffers(logRevealage ? 1 : 2, attachments);
+}
+
+void SceneRenderer::Impl::WBOITRenderStrategy::DeleteGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glDeleteFramebuffers(1, &framebuffer);
+    f->glDeleteTextures    (1, &colorTexture);
+    if (!logRevealage) f->glDeleteTextures(1, &alphaTexture);
+    f->glDeleteTextures    (1, &tileMask    );
+    reduced.DeleteGLResources();
+}
+
+void SceneRenderer::Impl::WBOITRenderStrategy::ReallocateFramebufferStorages(int w, int h)
+{
+    auto f = GLFunctions();
+
+    w = impl.Reduced(w); h = impl.Reduced(h);
+    auto colorFormat = impl.Format(TargetEnum::WBOITColor    ),
+         alphaFormat = impl.Format(TargetEnum::WBOITRevealage);
+    bool full = impl.accumulationScale == 1; // reduced targets aren't used then
+    std::vector<GLenum> formats = { colorFormat, alphaFormat };
+    if (logRevealage) formats.pop_back();
+    reduced.ReallocateStorages(full ? 1 : w, full ? 1 : h, formats);
+
+    f->glBindTexture(GL_TEXTURE_2D, tileMask);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // no mipmaps
+    f->glTexImage2D( GL_TEXTURE_2D, 0, GL_R8UI, (w + g_tileSize - 1) / g_tileSize,
+                     (h + g_tileSize - 1) / g_tileSize, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+                     nullptr                                                              );
+
+    f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, colorTexture);
+    f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, impl.AccumulationSamples(),
+                                colorFormat, w, h, GL_TRUE                            );
+    if (logRevealage) return;
+    f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, alphaTexture);
+    f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, impl.AccumulationSamples(),
+                                alphaFormat, w, h, GL_TRUE                            );
+}
+
+void SceneRenderer::Impl::WBOITRenderStrategy::Render(GLuint defaultFBO) const
+{
+    auto f = GLFunctions();
+
+    OpaqueTargets opaque{};
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Opaque);
+        opaque = impl.SharedOpaquePass();
+    }
+
+    static constexpr GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static constexpr GLfloat clearAlpha = 1.0f;
+
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::ClearAccumulation);
+        if (impl.accumulationScale != 1) reduced.Prepare(framebuffer, opaque.depthTexture);
+        else
+        {
+            f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                       GL_TEXTURE_2D_MULTISAMPLE, opaque.depthTexture, 0 );
+        }
+        f->glClearBufferfv(GL_COLOR, 0,  clearColor);
+        if (!logRevealage) f->glClearBufferfv(GL_COLOR, 1, &clearAlpha);
+        static constexpr GLubyte clearTile = 0;
+        f->glClearTexImage(tileMask, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &clearTile);
+    }
+
+    f->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    PrepareToTransparentRendering();
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Transparent);
+        impl.DrawTransparentWalls( logRevealage ? WallBatch::TransparentMode::WBOITLog
+                                                : WallBatch::TransparentMode::WBOIT    );
+    }
+    CleanupAfterTransparentRendering();
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
+    f->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    ApplyTextures(opaque);
+}
+
+
+
+void SceneRenderer::Impl::WBOITRenderStrategy::PrepareToTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glEnable(GL_DEPTH_TEST); f->glDepthMask(GL_FALSE); f->glDepthFunc(GL_LEQUAL);
+    f->glDisable(GL_CULL_FACE); f->glEnable(GL_MULTISAMPLE);
+
+    f->glEnable(GL_BLEND);
+
+    f->glBindImageTexture(0, tileMask, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+
+    f->glBlendFunci(0, GL_ONE, GL_ONE);
+    f->glBlendEquationi(0, GL_FUNC_ADD);
+    if (logRevealage) return;
+
+    f->glBlendFunci(1, GL_DST_COLOR, GL_ZERO);
+    f->glBlendEquationi(1, GL_FUNC_ADD);
+}
+
+void SceneRenderer::Impl::WBOITRenderStrategy::CleanupAfterTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glDepthMask(GL_TRUE); f->glDisable(GL_BLEND);
+    f->glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+}
+
+
+
+// One per share group like GlassWall_GLProgram, see GLProgram()
+struct ApplyTTexturesGLResources {
+    ShaderProgram program;
+
+    explicit ApplyTTexturesGLResources(bool perSample)
+    {
+        program.AddShader(
+                    GL_VERTEX_SHADER,
+                    "#version 450 core                                            \n"
+                    "const vec2 p[4] = vec2[4](                                   \n"
+                    "     vec2(-1, -1), vec2( 1, -1), vec2( 1,  1), vec2(-1,  1)  \n"
+                    "                         );                                  \n"
+                    "void main() { gl_Position = vec4(p[gl_VertexID], 0, 1); }    \n"
+                    );
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTextureNT;            \n"
+                    "layout (location = 1) uniform  sampler2DMS colorTexture;              \n"
+                    "layout (location = 2) uniform  sampler2DMS alphaTexture;              \n"
+                              ) + g_tileMaskGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    vec3  colorNT = texelFetch(colorTextureNT, upos, SAMPLE).rgb;     \n"
+                    "    if (!Transparent(upos))                                           \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    vec4 cc = texelFetch(colorTexture, upos, SAMPLE);                 \n"
+                    "    vec3 sumOfColors = cc.rgb;                                        \n"
+                    "    float sumOfWeights = cc.a;                                        \n"
+                    "                                                                      \n"
+                    "    if (sumOfWeights == 0)                                            \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    float alpha = 1 - texelFetch(alphaTexture, upos, SAMPLE).r;       \n"
+                    "    colorNT = sumOfColors / sumOfWeights * alpha +                    \n"
+                    "              colorNT * (1 - alpha);                                  \n"
+                    "    outColor = vec4(colorNT, 1.0);                                    \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+// Accumulation of reduced resolution, resolved
+struct ApplyReducedTTexturesGLResources {
+    ShaderProgram program;
+
+    explicit ApplyReducedTTexturesGLResources(bool perSample)
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTextureNT;            \n"
+                    "layout (location = 1) uniform  sampler2D   colorTexture;              \n"
+                    "layout (location = 2) uniform  sampler2D   alphaTexture;              \n"
+                              ) + g_upsamplingGLSL + g_tileMaskGLSL + g_reducedTileMaskGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    vec3  colorNT = texelFetch(colorTextureNT, upos, SAMPLE).rgb;     \n"
+                    "    if (!TransparentNear(upos))                                       \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    ivec2 texels[4]; float weights[4];                                \n"
+                    "    Upsampling(upos, texels, weights);                                \n"
+                    "                                                                      \n"
+                    "    vec4 cc = vec4(0); float revealage = 0;                           \n"
+                    "    for (int i = 0; i != 4; ++i) {                                    \n"
+                    "        cc        += weights[i] * texelFetch(colorTexture, texels[i], 0);  \n"
+                    "        revealage += weights[i] * texelFetch(alphaTexture, texels[i], 0).r;\n"
+                    "    }                                                                 \n"
+                    "    vec3 sumOfColors = cc.rgb;                                        \n"
+                    "    float sumOfWeights = cc.a;                                        \n"
+                    "                                                                      \n"
+                    "    if (sumOfWeights == 0)                                            \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    float alpha = 1 - revealage;                                      \n"
+                    "    colorNT = sumOfColors / sumOfWeights * alpha +                    \n"
+                    "              colorNT * (1 - alpha);                                  \n"
+                    "    outColor = vec4(colorNT, 1.0);                                    \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+// WBOITLog: the sum of weights in alpha is -log of the revealage
+struct ApplyTTexturesGLResources_WBOITLog {
+    ShaderProgram program;
+
+    explicit ApplyTTexturesGLResources_WBOITLog(bool perSample)
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTextureNT;            \n"
+                    "layout (location = 1) uniform  sampler2DMS colorTexture;              \n"
+                              ) + g_tileMaskGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    vec3  colorNT = texelFetch(colorTextureNT, upos, SAMPLE).rgb;     \n"
+                    "    if (!Transparent(upos))                                           \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    vec4 cc = texelFetch(colorTexture, upos, SAMPLE);                 \n"
+                    "                                                                      \n"
+                    "    if (cc.a == 0)                                                    \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    float alpha = 1 - exp(-cc.a);                                     \n"
+                    "    colorNT = cc.rgb / cc.a * alpha + colorNT * (1 - alpha);          \n"
+                    "    outColor = vec4(colorNT, 1.0);                                    \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+// WBOITLog accumulation of reduced resolution, resolved
+struct ApplyReducedTTexturesGLResources_WBOITLog {
+    ShaderProgram program;
+
+    explicit ApplyReducedTTexturesGLResources_WBOITLog(bool perSample)
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTextureNT;            \n"
+                    "layout (location = 1) uniform  sampler2D   colorTexture;              \n"
+                              ) + g_upsamplingGLSL + g_tileMaskGLSL + g_reducedTileMaskGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    vec3  colorNT = texelFetch(colorTextureNT, upos, SAMPLE).rgb;     \n"
+                    "    if (!TransparentNear(upos))                                       \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    ivec2 texels[4]; float weights[4];                                \n"
+                    "    Upsampling(upos, texels, weights);                                \n"
+                    "                                                                      \n"
+                    "    vec4 cc = vec4(0);                                                \n"
+                    "    for (int i = 0; i != 4; ++i)                                      \n"
+                    "        cc += weights[i] * texelFetch(colorTexture, texels[i], 0);    \n"
+                    "                                                                      \n"
+                    "    if (cc.a == 0)                                                    \n"
+                    "    { outColor = vec4(colorNT, 1.0); return; }                        \n"
+                    "                                                                      \n"
+                    "    float alpha = 1 - exp(-cc.a);                                     \n"
+                    "    colorNT = cc.rgb / cc.a * alpha + colorNT * (1 - alpha);          \n"
+                    "    outColor = vec4(colorNT, 1.0);                                    \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+void SceneRenderer::Impl::WBOITRenderStrategy::ApplyTextures(OpaqueTargets opaque) const
+{
+    auto f = GLFunctions();
+    Impl::PassScope scope(impl, GPUPassTimer::Pass::Composite);
+
+    if (impl.accumulationScale == 1)
+    {
+        auto program = [this](bool perSample) -> ShaderProgram &
+        {
+            return logRevealage
+                   ? GLProgram<ApplyTTexturesGLResources_WBOITLog>(perSample, perSample).program
+                   : GLProgram<ApplyTTexturesGLResources         >(perSample, perSample).program;
+        };
+        std::vector<GLuint> edgeTextures{ opaque.colorTexture, colorTexture };
+        if (!logRevealage) edgeTextures.push_back(alphaTexture);
+
+        impl.DrawComposite( program(false), program(true), edgeTextures, tileMask,
+                            [this, f, opaque]
+        {
+            f->glBindTextureUnit(0, opaque.colorTexture); f->glUniform1i(0, 0);
+            f->glBindTextureUnit(1, colorTexture); f->glUniform1i(1, 1);
+            f->glBindTextureUnit(7, tileMask    ); f->glUniform1i(7, 7);
+            if (!logRevealage) { f->glBindTextureUnit(2, alphaTexture); f->glUniform1i(2, 2); }
+        });
+    }
+    else
+    {
+        reduced.Resolve(framebuffer);
+
+        auto program = [this](bool perSample) -> ShaderProgram &
+        {
+            return logRevealage
+                   ? GLProgram<ApplyReducedTTexturesGLResources_WBOITLog>( perSample,
+                                                                           perSample ).program
+                   : GLProgram<ApplyReducedTTexturesGLResources         >( perSample,
+                                                                           perSample ).program;
+        };
+        // Upsampled accumulation is the same at all samples of a pixel
+        impl.DrawComposite( program(false), program(true),
+                            { opaque.colorTexture, opaque.depthTexture }, 0, [this, f, opaque]
+        {
+            f->glBindTextureUnit(0, opaque.colorTexture); f->glUniform1i(0, 0);
+            f->glBindTextureUnit(7, tileMask           ); f->glUniform1i(7, 7);
+            f->glBindTextureUnit(1, reduced.resolvedTextures[0]); f->glUniform1i(1, 1);
+            if (!logRevealage)
+            { f->glBindTextureUnit(2, reduced.resolvedTextures[1]); f->glUniform1i(2, 2); }
+            reduced.BindUpsampling(opaque.depthTexture);
+        });
+    }
+}
+
+std::vector<ShaderProgram *> SceneRenderer::Impl::WBOITRenderStrategy::Programs() const
+{
+    auto ret = WallPrograms( logRevealage ? WallBatch::TransparentMode::WBOITLog
+                                          : WallBatch::TransparentMode::WBOIT    );
+    ret.push_back(&GLProgram<DownsampleDepthGLResources>(0).program);
+    ret.push_back(&GLProgram<MarkEdgesGLResources      >(0).program);
+    for (bool perSample : { false, true })
+    {
+        auto s = perSample;
+        if (logRevealage)
+        {
+            ret.push_back(&GLProgram<ApplyTTexturesGLResources_WBOITLog       >(s, s).program);
+            ret.push_back(&GLProgram<ApplyReducedTTexturesGLResources_WBOITLog>(s, s).program);
+        }
+        else
+        {
+            ret.push_back(&GLProgram<ApplyTTexturesGLResources       >(s, s).program);
+            ret.push_back(&GLProgram<ApplyReducedTTexturesGLResources>(s, s).program);
+        }
+    }
+    return ret;
+}
+
+
+
+
+
+void SceneRenderer::Impl::CODBRenderStrategy::Render(GLuint defaultFBO) const
+{
+    auto f = GLFunctions();
+
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Opaque);
+        auto opaque = impl.SharedOpaquePass();
+
+        f->glBindFramebuffer(GL_FRAMEBUFFER, 0); /* Anti-aliasing doesn't work
+            if you don't switch framebuffers here, hell if I know why.         */
+        f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
+        impl.CopyOpaque(opaque, true);
+    }
+
+    f->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    PrepareToTransparentRendering();
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Transparent);
+        impl.DrawTransparentWalls(WallBatch::TransparentMode::CODB);
+    }
+    CleanupAfterTransparentRendering();
+}
+
+std::vector<ShaderProgram *> SceneRenderer::Impl::CODBRenderStrategy::Programs() const
+{
+    auto ret = WallPrograms(WallBatch::TransparentMode::CODB);
+    ret.push_back(&GLProgram<CopyOpaqueGLResources>(0).program);
+    return ret;
+}
+
+
+
+void SceneRenderer::Impl::CODBRenderStrategy::PrepareToTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glEnable(GL_DEPTH_TEST); f->glDepthMask(GL_FALSE); f->glDepthFunc(GL_LEQUAL);
+    f->glDisable(GL_CULL_FACE); f->glEnable(GL_MULTISAMPLE);
+
+    f->glEnable(GL_BLEND);
+
+    f->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    f->glBlendEquation(GL_FUNC_ADD);
+}
+
+void SceneRenderer::Impl::CODBRenderStrategy::CleanupAfterTransparentRendering() const
+{ auto f = GLFunctions(); f->glDepthMask(GL_TRUE); f->glDisable(GL_BLEND); }
+
+
+
+void SceneRenderer::Impl::AdditiveRenderStrategy::Render(GLuint defaultFBO) const
+{
+    auto f = GLFunctions();
+
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Opaque);
+        auto opaque = impl.SharedOpaquePass();
+
+        f->glBindFramebuffer(GL_FRAMEBUFFER, 0); /* Anti-aliasing doesn't work
+            if you don't switch framebuffers here, hell if I know why.         */
+        f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
+        impl.CopyOpaque(opaque, true);
+    }
+
+    f->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    PrepareToTransparentRendering();
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Transparent);
+        impl.DrawTransparentWalls(WallBatch::TransparentMode::Additive);
+    }
+    CleanupAfterTransparentRendering();
+}
+
+std::vector<ShaderProgram *> SceneRenderer::Impl::AdditiveRenderStrategy::Programs() const
+{
+    auto ret = WallPrograms(WallBatch::TransparentMode::Additive);
+    ret.push_back(&GLProgram<CopyOpaqueGLResources>(0).program);
+    return ret;
+}
+
+
+
+void SceneRenderer::Impl::AdditiveRenderStrategy::PrepareToTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glEnable(GL_DEPTH_TEST); f->glDepthMask(GL_FALSE); f->glDepthFunc(GL_LEQUAL);
+    f->glDisable(GL_CULL_FACE); f->glEnable(GL_MULTISAMPLE);
+
+    f->glEnable(GL_BLEND);
+
+    f->glBlendFunc(GL_ONE, GL_ONE);
+    f->glBlendEquation(GL_FUNC_ADD);
+}
+
+void SceneRenderer::Impl::AdditiveRenderStrategy::CleanupAfterTransparentRendering() const
+{ auto f = GLFunctions(); f->glDepthMask(GL_TRUE); f->glDisable(GL_BLEND); }
+
+
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::GenGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glGenFramebuffers(1, &framebuffer );
+    f->glGenTextures    (1, &colorTexture);
+    reduced.GenGLResources();
+
+    ReallocateFramebufferStorages(1, 1);
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D_MULTISAMPLE, colorTexture, 0 );
+    // depth is attached at rendering, see SharedOpaquePass()
+}
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::DeleteGLResources()
+{
+    auto f = GLFunctions();
+
+    f->glDeleteFramebuffers(1, &framebuffer);
+    f->glDeleteTextures    (1, &colorTexture);
+    reduced.DeleteGLResources();
+}
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::ReallocateFramebufferStorages(int w, int h)
+{
+    auto f = GLFunctions();
+
+    w = impl.Reduced(w); h = impl.Reduced(h);
+    auto colorFormat = impl.Format(TargetEnum::AdditiveEPColor);
+    bool full = impl.accumulationScale == 1; // reduced targets aren't used then
+    reduced.ReallocateStorages(full ? 1 : w, full ? 1 : h, { colorFormat });
+
+    f->glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, colorTexture);
+    f->glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, impl.AccumulationSamples(),
+                                colorFormat, w, h, GL_TRUE                            );
+}
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::Render(GLuint defaultFBO) const
+{
+    auto f = GLFunctions();
+
+    OpaqueTargets opaque{};
+    if (impl.accumulationScale == 1)
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Opaque);
+        opaque = impl.SharedOpaquePass();
+
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        f->glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_2D_MULTISAMPLE, opaque.depthTexture, 0 );
+        impl.CopyOpaque(opaque, false); // depth is tested against, never written
+    }
+    else // transparent walls only, the composite adds the opaque ones
+    {
+        {
+            Impl::PassScope scope(impl, GPUPassTimer::Pass::Opaque);
+            opaque = impl.SharedOpaquePass();
+        }
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::ClearAccumulation);
+        reduced.Prepare(framebuffer, opaque.depthTexture);
+        static constexpr GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        f->glClearBufferfv(GL_COLOR, 0, clearColor);
+    }
+
+    f->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    PrepareToTransparentRendering();
+    {
+        Impl::PassScope scope(impl, GPUPassTimer::Pass::Transparent);
+        impl.DrawTransparentWalls(WallBatch::TransparentMode::Additive);
+    }
+    CleanupAfterTransparentRendering();
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
+    f->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    ApplyTextures(opaque);
+}
+
+
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::PrepareToTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glEnable(GL_DEPTH_TEST); f->glDepthMask(GL_FALSE); f->glDepthFunc(GL_LEQUAL);
+    f->glDisable(GL_CULL_FACE); f->glEnable(GL_MULTISAMPLE);
+
+    f->glEnable(GL_BLEND);
+
+    f->glBlendFunc(GL_ONE, GL_ONE);
+    f->glBlendEquation(GL_FUNC_ADD);
+}
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::CleanupAfterTransparentRendering() const
+{
+    auto f = GLFunctions();
+    f->glDepthMask(GL_TRUE);
+    f->glDisable(GL_BLEND);
+}
+
+
+
+struct ApplyTTexturesGLResources_AdditiveEP {
+    ShaderProgram program;
+
+    explicit ApplyTTexturesGLResources_AdditiveEP(bool perSample)
+    {
+        program.AddShader(
+                    GL_VERTEX_SHADER,
+                    "#version 450 core                                            \n"
+                    "const vec2 p[4] = vec2[4](                                   \n"
+                    "     vec2(-1, -1), vec2( 1, -1), vec2( 1,  1), vec2(-1,  1)  \n"
+                    "                         );                                  \n"
+                    "void main() { gl_Position = vec4(p[gl_VertexID], 0, 1); }    \n"
+                    );
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTexture;              \n"
+                    "                                                                      \n"
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    vec3 color = texelFetch(colorTexture, upos, SAMPLE).rgb;          \n"
+                    "                                                                      \n"
+                    "    outColor = vec4(vec3(1) - exp(- 0.8 * color), 1.0);               \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+// Accumulation of reduced resolution, resolved, over the opaque walls
+struct ApplyReducedTTexturesGLResources_AdditiveEP {
+    ShaderProgram program;
+
+    explicit ApplyReducedTTexturesGLResources_AdditiveEP(bool perSample)
+    {
+        program.AddShader(GL_VERTEX_SHADER, g_fullScreenVertexGLSL);
+        program.AddShader(
+                    GL_FRAGMENT_SHADER,
+                    CompositeShader(
+                    QByteArray(
+                    "#version 450 core                                                     \n"
+                    "out vec4 outColor;                                                    \n"
+                    "                                                                      \n"
+                    "layout (location = 0) uniform  sampler2DMS colorTextureNT;            \n"
+                    "layout (location = 1) uniform  sampler2D   colorTexture;              \n"
+                              ) + g_upsamplingGLSL +
+                    "void main() {                                                         \n"
+                    "    ivec2 upos = ivec2(gl_FragCoord.xy);                              \n"
+                    "    ivec2 texels[4]; float weights[4];                                \n"
+                    "    Upsampling(upos, texels, weights);                                \n"
+                    "                                                                      \n"
+                    "    vec3 color = texelFetch(colorTextureNT, upos, SAMPLE).rgb;        \n"
+                    "    for (int i = 0; i != 4; ++i)                                      \n"
+                    "        color += weights[i] * texelFetch(colorTexture, texels[i], 0).rgb;\n"
+                    "                                                                      \n"
+                    "    outColor = vec4(vec3(1) - exp(- 0.8 * color), 1.0);               \n"
+                    "}                                                                     \n"
+                                   , perSample )
+                    );
+        program.Link();
+    }
+};
+
+void SceneRenderer::Impl::AdditiveEPRenderStrategy::ApplyTextures(OpaqueTargets opaque) const
+{
+    auto f = GLFunctions();
+    Impl::PassScope scope(impl, GPUPassTimer::Pass::Composite);
+
+    if (impl.accumulationScale == 1)
+    {
+        using Res = ApplyTTexturesGLResources_AdditiveEP;
+        impl.DrawComposite( GLProgram<Res>(false, false).program,
+                            GLProgram<Res>(true , true ).program, { colorTexture }, 0, [this, f]
+        {
+            f->glBindTextureUnit(0, colorTexture);
+            f->glUniform1i(0, 0);
+        });
+    }
+    else
+    {
+        reduced.Resolve(framebuffer);
+
+        using Res = ApplyReducedTTexturesGLResources_AdditiveEP;
+        impl.DrawComposite( GLProgram<Res>(false, false).program,
+                            GLProgram<Res>(true , true ).program,
+                            { opaque.colorTexture, opaque.depthTexture }, 0, [this, f, opaque]
+        {
+            f->glBindTextureUnit(0, opaque.colorTexture          ); f->glUniform1i(0, 0);
+            f->glBindTextureUnit(1, reduced.resolvedTextures[0]); f->glUniform1i(1, 1);
+            reduced.BindUpsampling(opaque.depthTexture);
+        });
+    }
+}
+
+std::vector<ShaderProgram *> SceneRenderer::Impl::AdditiveEPRenderStrategy::Programs() const
+{
+    auto ret = WallPrograms(WallBatch::TransparentMode::Additive);
+    ret.push_back(&GLProgram<CopyOpaqueGLResources                      >(0).program);
+    ret.push_back(&GLProgram<DownsampleDepthGLResources                 >(0).program);
+    ret.push_back(&GLProgram<MarkEdgesGLResources                       >(0).program);
+    for (bool perSample : { false, true })
+    {
+        auto s = perSample;
+        ret.push_back(&GLProgram<ApplyTTexturesGLResources_AdditiveEP       >(s, s).program);
+        ret.push_back(&GLProgram<ApplyReducedTTexturesGLResources_AdditiveEP>(s, s).program);
+    }
+    return ret;
+}
+
+
+
+
+
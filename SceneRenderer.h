@@ -0,0 +1,120 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <memory>
+#include <vector>
+#include <QGenericMatrix>
+
+#include "GLDrawingFacilities.h"
+#include "GPUPassTimer.h"
+
+// Renders all glass walls with one of the transparency strategies into a framebuffer
+// of the current GL context. Doesn't own the context, so it can be used both
+// by GLWidget and by offscreen contexts. All methods except ctor, dtor and getters
+// must be called with the target context current.
+class SceneRenderer
+{
+public:
+    // WBOITLog is WBOIT with weights of -log(1 - opacity): their sum gives the revealage,
+    // so it accumulates into the color target only, with additive blending
+    enum class RenderStrategyEnum { WBOIT, WBOITLog, CODB, Additive, AdditiveEP };
+    static constexpr RenderStrategyEnum allStrategies[] = {
+        RenderStrategyEnum::WBOIT, RenderStrategyEnum::WBOITLog, RenderStrategyEnum::CODB,
+        RenderStrategyEnum::Additive, RenderStrategyEnum::AdditiveEP
+    };
+    static const char * StrategyName(RenderStrategyEnum strategy);
+
+    // PerWall: draw calls and state changes per wall. Batched: WallBatch, a few
+    // indirect multi-draws per frame whatever the count of walls; falls back to PerWall
+    // if the GL implementation can't run it
+    enum class DrawPathEnum { PerWall, Batched };
+    static constexpr DrawPathEnum allDrawPaths[] = { DrawPathEnum::PerWall, DrawPathEnum::Batched };
+    static const char * DrawPathName(DrawPathEnum path);
+    // VertexPulling (default) falls back to GeometryShader without shader storage
+    // blocks in vertex shaders; see VertexPipelineEnum
+    static constexpr VertexPipelineEnum allVertexPipelines[] = {
+        VertexPipelineEnum::GeometryShader, VertexPipelineEnum::VertexPulling
+    };
+    static const char * VertexPipelineName(VertexPipelineEnum pipeline);
+    // Shading of the composite of WBOIT(Log) and AdditiveEP. PerSample: every sample.
+    // EdgeAware (default): a pixel-rate pass marks pixels whose samples of the inputs differ
+    // in the stencil buffer, then other pixels are shaded once and marked ones per sample;
+    // the framebuffer passed to Render() needs a stencil buffer, whose content is lost
+    enum class CompositeEnum { PerSample, EdgeAware };
+    static constexpr CompositeEnum allComposites[] = {
+        CompositeEnum::PerSample, CompositeEnum::EdgeAware
+    };
+    static const char * CompositeName(CompositeEnum composite);
+    static QMatrix3x3 ProjectionMatrix(int width, int height); // keeps the aspect ratio
+
+    // Render targets with a selectable internal format: the color of the opaque walls,
+    // the accumulated color and weight and the revealage of WBOIT, the accumulated
+    // color of AdditiveEP
+    enum class TargetEnum { OpaqueColor, WBOITColor, WBOITRevealage, AdditiveEPColor };
+    static constexpr TargetEnum allTargets[] = {
+        TargetEnum::OpaqueColor, TargetEnum::WBOITColor,
+        TargetEnum::WBOITRevealage, TargetEnum::AdditiveEPColor
+    };
+    static const char * TargetName(TargetEnum target);
+    static std::vector<TargetEnum> StrategyTargets(RenderStrategyEnum strategy); // it renders to
+    // Formats a target can take, the default one first
+    static const std::vector<GLenum> & TargetFormats(TargetEnum target);
+    static GLenum ReferenceFormat(TargetEnum target); // float32 ones
+    static const char * FormatName(GLenum format); // e.g. "RGBA16F"
+    static int FormatBytes(GLenum format); // per sample
+
+    // numOfSamples must match the sample count of the framebuffer passed to Render()
+    explicit SceneRenderer(RenderStrategyEnum strategy, GLsizei numOfSamples);
+    ~SceneRenderer();
+    SceneRenderer(const SceneRenderer & ) = delete;
+    SceneRenderer(      SceneRenderer &&) = delete;
+    SceneRenderer & operator=(const SceneRenderer & ) = delete;
+    SceneRenderer & operator=(      SceneRenderer &&) = delete;
+
+    RenderStrategyEnum Strategy() const;
+    GLsizei NumOfSamples() const;
+    DrawPathEnum DrawPath() const;
+    void DrawPath(DrawPathEnum path);
+    VertexPipelineEnum VertexPipeline() const;
+    void VertexPipeline(VertexPipelineEnum pipeline);
+    CompositeEnum Composite() const;
+    void Composite(CompositeEnum composite);
+
+    // WBOIT(Log) and AdditiveEP can accumulate transparent walls at 1/scale of the resolution
+    // (1, 2 or 4) with a sample count of their own, then upsample the result over the opaque
+    // walls weighting texels by the similarity of depth. Other strategies ignore it
+    static constexpr int allAccumulationScales[] = { 1, 2, 4 };
+    int AccumulationScale() const;
+    GLsizei AccumulationSamples() const; // NumOfSamples() at scale 1
+    void Accumulation(int scale, GLsizei samples); // samples are ignored at scale 1
+
+    GLenum TargetFormat(TargetEnum target) const;
+    void TargetFormat(TargetEnum target, GLenum format); // one of TargetFormats(target)
+    // Bytes of the render targets the strategy uses (not the framebuffer passed to Render())
+    // per pixel shown, all samples counted
+    double BytesPerPixel() const;
+
+    void GenGLResources();
+    void DeleteGLResources();
+    void Resize(int width, int height); // also sets viewport
+    void Render(GLuint defaultFBO) const;
+
+    // Starts linking every program the strategy can use (see ShaderProgram), so none
+    // is compiled in the middle of a later frame. Render() waits for those not ready
+    void WarmUpPrograms();
+    bool ProgramsReady(); // of WarmUpPrograms(); doesn't wait
+
+    // Per pass GPU times of previous frames; call CollectPassTimings() regularly,
+    // otherwise frames stop being measured
+    const GPUPassTimer & PassTimer() const;
+    bool CollectPassTimings(); // true if averages changed
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // SCENERENDERER_H
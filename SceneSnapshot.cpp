@@ -0,0 +1,22 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "SceneSnapshot.h"
+
+SceneSnapshot SceneSnapshot::FromGlassWalls()
+{
+    SceneSnapshot ret;
+    ret.walls.reserve(GlassWall::CountOfInstances());
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); !iter.AtEnd(); ++iter)
+    {
+        if (!iter->Visible()) continue;
+        auto & wall = ret.walls.emplace_back(Wall{ iter->Depth(), iter->Opacity(),
+                                                   iter->Transparent(),
+                                                   iter->Transformation(), {} });
+        wall.triangles.reserve(iter->CountOfTriangles());
+        for (size_t i = 0; i != iter->CountOfTriangles(); ++i)
+            wall.triangles.push_back(iter->GetTriangle(i));
+    }
+    return ret;
+}
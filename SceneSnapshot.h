@@ -0,0 +1,28 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef SCENESNAPSHOT_H
+#define SCENESNAPSHOT_H
+
+#include <vector>
+
+#include "GlassWall.h"
+
+// Plain copy of the glass walls for CPU-side tools, which may process it on
+// many threads or build it from something else than g_gwalls
+struct SceneSnapshot
+{
+    struct Wall
+    {
+        GLfloat depth; // as in GlassWall::Depth()
+        float opacity;
+        bool transparent;
+        QMatrix3x3 transformation;
+        std::vector<GlassWall::Triangle> triangles;
+    };
+    std::vector<Wall> walls; // visible ones only, in drawing order: from far to near
+
+    static SceneSnapshot FromGlassWalls();
+};
+
+#endif // SCENESNAPSHOT_H
@@ -0,0 +1,202 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "ShaderProgram.h"
+
+#include <QOpenGLContext>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+#include <vector>
+#include <cstring>
+
+static constexpr GLenum g_completionStatus = 0x91B1; // GL_COMPLETION_STATUS_KHR, _ARB
+
+static bool HasParallelCompile() // of the current context
+{
+    auto context = QOpenGLContext::currentContext();
+    return    context->hasExtension(QByteArrayLiteral("GL_KHR_parallel_shader_compile"))
+           || context->hasExtension(QByteArrayLiteral("GL_ARB_parallel_shader_compile"));
+}
+
+// Empty if binaries aren't cached
+static QString CachePath(const std::vector<std::pair<GLenum, QByteArray>> & sources)
+{
+    if (QCoreApplication::testAttribute(Qt::AA_DisableShaderDiskCache)) return {};
+    static const QString dir = []
+    {
+        auto cache = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        return cache.isEmpty() ? cache : cache + QStringLiteral("/programs");
+    }();
+    if (dir.isEmpty()) return {};
+
+    auto f = GLFunctions();
+    GLint formats = 0;
+    f->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats == 0) return {};
+
+    // Binaries of another driver, or of its other version, are never tried
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        hash.addData(QByteArray(reinterpret_cast<const char *>(f->glGetString(name))) + '\n');
+    for (auto & [type, source] : sources)
+        hash.addData(QByteArray::number(type) + '\n' + source + '\n');
+    return dir + '/' + QString::fromLatin1(hash.result().toHex()) + QStringLiteral(".bin");
+}
+
+// File: the binary format, then the binary
+static bool LoadBinary(GLuint program, const QString & path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    auto data = file.readAll();
+    GLenum format = 0;
+    if (data.size() <= static_cast<int>(sizeof(format))) return false;
+    std::memcpy(&format, data.constData(), sizeof(format));
+
+    auto f = GLFunctions();
+    f->glProgramBinary( program, format, data.constData() + sizeof(format),
+                        static_cast<GLsizei>(data.size() - static_cast<int>(sizeof(format))) );
+    GLint linked = GL_FALSE;
+    f->glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+static void SaveBinary(GLuint program, const QString & path)
+{
+    auto f = GLFunctions();
+    GLint length = 0;
+    f->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    GLenum format = 0;
+    QByteArray data(static_cast<int>(sizeof(format)) + length, Qt::Uninitialized);
+    f->glGetProgramBinary(program, length, nullptr, &format, data.data() + sizeof(format));
+    std::memcpy(data.data(), &format, sizeof(format));
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path); // other instances may be reading the old one meanwhile
+    if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size()) file.commit();
+}
+
+struct ShaderProgram::Impl
+{
+    enum class State { New, Linking, Linked, Failed };
+
+    std::vector<std::pair<GLenum, QByteArray>> sources;
+    State state = State::New;
+    GLuint program = 0;
+    std::vector<GLuint> shaders; // while linking
+    QOpenGLContextGroup * group = nullptr;
+    QString cachePath;
+
+    void Finish();
+};
+
+void ShaderProgram::Impl::Finish()
+{
+    assert(state == State::Linking);
+    auto f = GLFunctions();
+
+    GLint linked = GL_FALSE;
+    f->glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    state = linked == GL_TRUE ? State::Linked : State::Failed;
+    if (state == State::Failed)
+    {
+        auto log = [](GLint length, auto get)
+        { QByteArray s(length, '\0'); if (length > 0) get(s.data()); return s; };
+        for (auto shader : shaders)
+        {
+            GLint length = 0;
+            f->glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            qWarning().noquote() << log( length, [f, shader, length](char * s)
+                                         { f->glGetShaderInfoLog(shader, length, nullptr, s); } );
+        }
+        GLint length = 0;
+        f->glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        qWarning().noquote() << log( length, [f, this, length](char * s)
+                                     { f->glGetProgramInfoLog(program, length, nullptr, s); } );
+    }
+    else if (!cachePath.isEmpty()) SaveBinary(program, cachePath);
+
+    for (auto shader : shaders) { f->glDetachShader(program, shader); f->glDeleteShader(shader); }
+    shaders.clear();
+}
+
+ShaderProgram::ShaderProgram() : impl(std::make_unique<Impl>()) {}
+
+ShaderProgram::~ShaderProgram()
+{
+    auto current = QOpenGLContext::currentContext();
+    if (!impl->program || !current || current->shareGroup() != impl->group) return;
+    auto f = GLFunctions();
+    for (auto shader : impl->shaders) f->glDeleteShader(shader);
+    f->glDeleteProgram(impl->program);
+}
+
+void ShaderProgram::AddShader(GLenum type, QByteArray source)
+{
+    assert(impl->state == Impl::State::New);
+    impl->sources.emplace_back(type, std::move(source));
+}
+
+void ShaderProgram::Link()
+{
+    assert(impl->state == Impl::State::New);
+    auto f = GLFunctions();
+    auto context = QOpenGLContext::currentContext();
+    impl->group = context->shareGroup();
+
+    impl->program = f->glCreateProgram();
+    impl->cachePath = CachePath(impl->sources);
+    if (!impl->cachePath.isEmpty())
+    {
+        if (LoadBinary(impl->program, impl->cachePath)) { impl->state = Impl::State::Linked; return; }
+        f->glDeleteProgram(impl->program); // a failed binary may leave it unusable
+        impl->program = f->glCreateProgram();
+        f->glProgramParameteri(impl->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    if (HasParallelCompile())
+    {
+        using MaxThreads = void (*)(GLuint);
+        auto maxThreads = reinterpret_cast<MaxThreads>(
+                              context->getProcAddress("glMaxShaderCompilerThreadsKHR") );
+        if (maxThreads) maxThreads(0xFFFFFFFF); // as many as the driver likes
+    }
+    // No status is queried till Ready() or Bind(), so the driver needn't wait for anything
+    for (auto & [type, source] : impl->sources)
+    {
+        auto shader = f->glCreateShader(type);
+        auto data = source.constData();
+        auto length = static_cast<GLint>(source.size());
+        f->glShaderSource(shader, 1, &data, &length);
+        f->glCompileShader(shader);
+        f->glAttachShader(impl->program, shader);
+        impl->shaders.push_back(shader);
+    }
+    f->glLinkProgram(impl->program);
+    impl->state = Impl::State::Linking;
+}
+
+bool ShaderProgram::Ready() const
+{
+    if (impl->state != Impl::State::Linking || !HasParallelCompile()) return true;
+    GLint done = GL_FALSE;
+    GLFunctions()->glGetProgramiv(impl->program, g_completionStatus, &done);
+    return done == GL_TRUE;
+}
+
+bool ShaderProgram::Bind()
+{
+    if (impl->state == Impl::State::Linking) impl->Finish();
+    if (impl->state != Impl::State::Linked) return false;
+    GLFunctions()->glUseProgram(impl->program);
+    return true;
+}
@@ -0,0 +1,39 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <QByteArray>
+#include <memory>
+
+#include "GLDrawingFacilities.h"
+
+// A program whose compiling and linking don't wait for the driver: with
+// GL_KHR_parallel_shader_compile (or the ARB one) programs linked one after another compile
+// at once, and Ready() tells if one is done without blocking; without it they finish one
+// by one at the first Bind(). Linked binaries are cached on disk, keyed by the sources and
+// the GL vendor, renderer and version, unless Qt::AA_DisableShaderDiskCache is set.
+// The program is deleted by dtor if a context of its share group is current,
+// otherwise it lives as long as the share group.
+class ShaderProgram
+{
+public:
+    explicit ShaderProgram();
+    ~ShaderProgram();
+    ShaderProgram(const ShaderProgram & ) = delete;
+    ShaderProgram(      ShaderProgram &&) = delete;
+    ShaderProgram & operator=(const ShaderProgram & ) = delete;
+    ShaderProgram & operator=(      ShaderProgram &&) = delete;
+
+    void AddShader(GLenum type, QByteArray source); // e.g. GL_VERTEX_SHADER; before Link()
+    void Link(); // starts compiling and linking, or loads the cached binary
+
+    bool Ready() const; // Bind() won't wait
+    bool Bind(); // waits for linking; false if it failed, with the log printed
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // SHADERPROGRAM_H
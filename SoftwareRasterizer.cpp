@@ -0,0 +1,425 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SWR_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "SceneSnapshot.h"
+#include "Parallel.h"
+
+namespace {
+
+struct Color { float r = 0, g = 0, b = 0; };
+
+Color ToColor(RGB16 c)
+{
+    constexpr float k = 1.0f / std::numeric_limits<uint16_t>::max();
+    return { c.r * k, c.g * k, c.b * k };
+}
+
+// Sample positions inside a pixel, in [0, 1). The common D3D/GL patterns for
+// 1, 2, 4, 8 and 16 samples; a Hammersley set otherwise.
+struct SamplePattern
+{
+    int count;
+    std::vector<float> x, y;
+
+    explicit SamplePattern(int n) : count(n), x(static_cast<size_t>(n)), y(static_cast<size_t>(n))
+    {
+        static constexpr int p1 [] = { 0, 0 };
+        static constexpr int p2 [] = { 4, 4, -4, -4 };
+        static constexpr int p4 [] = { -2, -6, 6, -2, -6, 2, 2, 6 };
+        static constexpr int p8 [] = { 1, -3, -1, 3, 5, 1, -3, -5, -5, 5, -7, -1, 3, 7, 7, -7 };
+        static constexpr int p16[] = { 1, 1, -1, -3, -3, 2, 4, -1, -5, -2, 2, 5, 5, 3, 3, -5,
+                                       -2, 6, 0, -7, -4, -6, -6, 4, -8, 0, 7, -4, 6, 7, -7, -8 };
+        const int * p = n == 1 ? p1 : n == 2 ? p2 : n == 4 ? p4 : n == 8 ? p8
+                      : n == 16 ? p16 : nullptr;
+        for (size_t i = 0; i != static_cast<size_t>(n); ++i)
+        {
+            if (p) { x[i] = 0.5f + p[2 * i] / 16.0f; y[i] = 0.5f + p[2 * i + 1] / 16.0f; continue; }
+            float ri = 0, f = 0.5f;
+            for (auto b = i; b; b >>= 1, f *= 0.5f) if (b & 1) ri += f;
+            x[i] = (i + 0.5f) / n; y[i] = ri;
+        }
+    }
+};
+
+// A triangle in window coordinates (pixels, origin at the bottom left)
+struct Primitive
+{
+    float a[3], b[3], c[3];  // edge functions a * x + b * y + c, all >= 0 inside
+    bool strict[3];          // not a top-left edge: must be > 0, so shared edges aren't hit twice
+    float minX = 1, maxX = 0, minY = 1, maxY = 0; // empty box for degenerate ones
+    float depth = 0;
+    Color color;
+    float opacity = 1;
+
+    bool IsEmpty() const { return minX > maxX; }
+
+    void Setup(QVector2D v0, QVector2D v1, QVector2D v2)
+    {
+        auto area = (v1.x() - v0.x()) * (v2.y() - v0.y()) - (v1.y() - v0.y()) * (v2.x() - v0.x());
+        if (!(std::abs(area) > 0)) return;
+        if (area < 0) std::swap(v1, v2); // both windings are drawn, face culling is disabled
+        const QVector2D v[3] = { v0, v1, v2 };
+        for (int i = 0; i != 3; ++i)
+        {
+            auto & p = v[i]; auto & q = v[(i + 1) % 3];
+            a[i] = p.y() - q.y();
+            b[i] = q.x() - p.x();
+            c[i] = p.x() * q.y() - q.x() * p.y();
+            strict[i] = !(a[i] > 0 || (a[i] == 0 && b[i] < 0));
+        }
+        minX = std::min({ v0.x(), v1.x(), v2.x() }); maxX = std::max({ v0.x(), v1.x(), v2.x() });
+        minY = std::min({ v0.y(), v1.y(), v2.y() }); maxY = std::max({ v0.y(), v1.y(), v2.y() });
+    }
+};
+
+struct TileRect { int x0, y0, x1, y1; }; // x1, y1 exclusive
+
+// Calls op(index of the sample in the tile) for every covered sample of the tile,
+// four pixels at a time
+template<class Op>
+void Rasterize(const Primitive & p, const TileRect & t, const SamplePattern & sp, Op && op)
+{
+    constexpr int T = SoftwareRasterizer::tileSize;
+    const int px0 = std::max(t.x0, static_cast<int>(std::floor(p.minX)));
+    const int px1 = std::min(t.x1, static_cast<int>(std::ceil (p.maxX)));
+    const int py0 = std::max(t.y0, static_cast<int>(std::floor(p.minY)));
+    const int py1 = std::min(t.y1, static_cast<int>(std::ceil (p.maxY)));
+    if (px0 >= px1 || py0 >= py1) return;
+
+    const int S = sp.count;
+#ifdef SWR_SSE2
+    const __m128 lanes = _mm_setr_ps(0, 1, 2, 3), zero = _mm_setzero_ps();
+    const __m128 a0 = _mm_set1_ps(p.a[0]), a1 = _mm_set1_ps(p.a[1]), a2 = _mm_set1_ps(p.a[2]);
+    // Non-strict edges are tested as E > -0, i.e. E >= 0, by flipping the comparison
+    auto inside = [zero](__m128 e, bool strict)
+    { return strict ? _mm_cmpgt_ps(e, zero) : _mm_cmpge_ps(e, zero); };
+#endif
+    for (int s = 0; s != S; ++s)
+        for (int y = py0; y != py1; ++y)
+        {
+            const float sy = y + sp.y[static_cast<size_t>(s)];
+            const float sx0 = sp.x[static_cast<size_t>(s)];
+            const int rowBase = ((y - t.y0) * T - t.x0) * S + s; // + x * S
+#ifdef SWR_SSE2
+            const __m128 e0y = _mm_set1_ps(p.b[0] * sy + p.c[0]);
+            const __m128 e1y = _mm_set1_ps(p.b[1] * sy + p.c[1]);
+            const __m128 e2y = _mm_set1_ps(p.b[2] * sy + p.c[2]);
+            for (int x = px0; x < px1; x += 4)
+            {
+                const __m128 sx = _mm_add_ps(_mm_set1_ps(x + sx0), lanes);
+                auto m = _mm_and_ps(
+                             _mm_and_ps( inside(_mm_add_ps(_mm_mul_ps(a0, sx), e0y), p.strict[0]),
+                                         inside(_mm_add_ps(_mm_mul_ps(a1, sx), e1y), p.strict[1]) ),
+                             inside(_mm_add_ps(_mm_mul_ps(a2, sx), e2y), p.strict[2])                );
+                int mask = _mm_movemask_ps(m);
+                if (px1 - x < 4) mask &= (1 << (px1 - x)) - 1;
+                for (int l = 0; mask; ++l, mask >>= 1)
+                    if (mask & 1) op(rowBase + (x + l) * S);
+            }
+#else
+            for (int x = px0; x != px1; ++x)
+            {
+                const float sx = x + sx0;
+                bool in = true;
+                for (int i = 0; i != 3 && in; ++i)
+                {
+                    auto e = p.a[i] * sx + p.b[i] * sy + p.c[i];
+                    in = p.strict[i] ? e > 0 : e >= 0;
+                }
+                if (in) op(rowBase + x * S);
+            }
+#endif
+        }
+}
+
+} // namespace
+
+struct SoftwareRasterizer::Impl
+{
+    explicit Impl(RenderStrategyEnum s, int numOfSamples, unsigned threads)
+        : strategy(s), pattern(numOfSamples), pool(threads)
+        , scratches(pool.Workers()) {}
+
+    RenderStrategyEnum strategy;
+    SamplePattern pattern;
+    ThreadPool pool;
+
+    int width = 0, height = 0, tilesX = 0, tilesY = 0;
+
+    std::vector<Primitive> opaquePrims, transparentPrims; // in drawing order
+
+    // bins[chunk][tile]: indices of primitives of the chunk touching the tile.
+    // Chunks are binned in parallel; walking them in order keeps the drawing order.
+    using Bins = std::vector<std::vector<std::vector<uint32_t>>>;
+    Bins opaqueBins, transparentBins;
+
+    struct Scratch // per worker samples of one tile
+    {
+        std::vector<float> depth;
+        std::vector<Color> color;
+        std::vector<Color> sumOfColors; // WBOIT only
+        std::vector<float> sumOfWeights, revealage;
+    };
+    std::vector<Scratch> scratches;
+
+    void SetupPrimitives(const SceneSnapshot & scene);
+    void Bin(const std::vector<Primitive> & prims, Bins & bins);
+    void ShadeTile(size_t tile, unsigned worker, uchar * bits, int bytesPerLine);
+};
+
+void SoftwareRasterizer::Impl::SetupPrimitives(const SceneSnapshot & scene)
+{
+    const auto & walls = scene.walls;
+    // The opaque pass draws edges of all walls (as 1 pixel wide quads, two triangles each)
+    // and faces of non-transparent ones; the transparent pass draws faces of the rest
+    std::vector<size_t> opaqueOffsets(walls.size() + 1), transparentOffsets(walls.size() + 1);
+    for (size_t i = 0; i != walls.size(); ++i)
+    {
+        auto n = walls[i].triangles.size();
+        opaqueOffsets     [i + 1] = opaqueOffsets[i] + n * 6 + (walls[i].transparent ? 0 : n);
+        transparentOffsets[i + 1] = transparentOffsets[i] + (walls[i].transparent ? n : 0);
+    }
+    opaquePrims     .assign(opaqueOffsets     .back(), Primitive());
+    transparentPrims.assign(transparentOffsets.back(), Primitive());
+
+    const auto projMat = SceneRenderer::ProjectionMatrix(width, height);
+    const float hw = width * 0.5f, hh = height * 0.5f;
+    pool.Run(walls.size(), [&](size_t i, unsigned)
+    {
+        auto & wall = walls[i];
+        auto m = projMat * wall.transformation;
+        auto toWindow = [&m, hw, hh](QVector2D p)
+        { return QVector2D( (m(0, 0) * p.x() + m(0, 1) * p.y() + m(0, 2) + 1) * hw,
+                            (m(1, 0) * p.x() + m(1, 1) * p.y() + m(1, 2) + 1) * hh  ); };
+
+        auto op = &opaquePrims[opaqueOffsets[i]];
+        auto tp = &transparentPrims[transparentOffsets[i]];
+        std::vector<QVector2D> window(wall.triangles.size() * 3);
+        for (size_t t = 0; t != wall.triangles.size(); ++t)
+        {
+            auto & tri = wall.triangles[t];
+            window[3 * t] = toWindow(tri.a); window[3 * t + 1] = toWindow(tri.b);
+            window[3 * t + 2] = toWindow(tri.c);
+        }
+
+        for (size_t t = 0; t != wall.triangles.size(); ++t)
+        {
+            auto edgeColor = ToColor(wall.triangles[t].edgeColor);
+            for (size_t e = 0; e != 3; ++e)
+            {
+                auto p = window[3 * t + e], q = window[3 * t + (e + 1) % 3];
+                auto d = q - p;
+                auto len = d.length();
+                Primitive quad[2];
+                if (len > 0)
+                {
+                    QVector2D n(-d.y() * 0.5f / len, d.x() * 0.5f / len);
+                    quad[0].Setup(p + n, q + n, q - n);
+                    quad[1].Setup(p + n, q - n, p - n);
+                }
+                for (auto & prim : quad)
+                { prim.depth = wall.depth; prim.color = edgeColor; *op++ = prim; }
+            }
+        }
+
+        auto & faces = wall.transparent ? tp : op;
+        for (size_t t = 0; t != wall.triangles.size(); ++t)
+        {
+            Primitive prim;
+            prim.Setup(window[3 * t], window[3 * t + 1], window[3 * t + 2]);
+            prim.depth = wall.depth;
+            prim.color = ToColor(wall.triangles[t].fillColor);
+            prim.opacity = wall.opacity;
+            *faces++ = prim;
+        }
+    });
+}
+
+void SoftwareRasterizer::Impl::Bin(const std::vector<Primitive> & prims, Bins & bins)
+{
+    const size_t chunks = pool.Workers(), tiles = static_cast<size_t>(tilesX) * tilesY;
+    bins.resize(chunks);
+    for (auto & chunk : bins)
+    {
+        chunk.resize(tiles);
+        for (auto & tile : chunk) tile.clear();
+    }
+
+    pool.Run(chunks, [&](size_t chunk, unsigned)
+    {
+        auto & cb = bins[chunk];
+        for (size_t i = prims.size() * chunk / chunks, end = prims.size() * (chunk + 1) / chunks;
+             i != end; ++i)
+        {
+            auto & p = prims[i];
+            if (p.IsEmpty() || p.maxX <= 0 || p.maxY <= 0 || p.minX >= width || p.minY >= height)
+                continue;
+            int tx0 = std::max(0, static_cast<int>(std::floor(p.minX)) / tileSize);
+            int ty0 = std::max(0, static_cast<int>(std::floor(p.minY)) / tileSize);
+            int tx1 = std::min(tilesX - 1, (static_cast<int>(std::ceil(p.maxX)) - 1) / tileSize);
+            int ty1 = std::min(tilesY - 1, (static_cast<int>(std::ceil(p.maxY)) - 1) / tileSize);
+            for (int ty = ty0; ty <= ty1; ++ty)
+                for (int tx = tx0; tx <= tx1; ++tx)
+                    cb[static_cast<size_t>(ty) * tilesX + tx].push_back(static_cast<uint32_t>(i));
+        }
+    });
+}
+
+void SoftwareRasterizer::Impl::ShadeTile( size_t tile, unsigned worker,
+                                          uchar * bits, int bytesPerLine )
+{
+    const int tx = static_cast<int>(tile % tilesX), ty = static_cast<int>(tile / tilesX);
+    const TileRect r{ tx * tileSize, ty * tileSize, std::min(width , (tx + 1) * tileSize),
+                                                    std::min(height, (ty + 1) * tileSize) };
+    const int S = pattern.count;
+    const size_t samples = static_cast<size_t>(tileSize) * tileSize * S;
+
+    auto & sc = scratches[worker];
+    sc.depth.assign(samples, 1.0f); // as glClearBufferfv(GL_DEPTH) in RenderNonTransparent
+    sc.color.assign(samples, Color());
+    const bool wboitLog = strategy == RenderStrategyEnum::WBOITLog,
+               wboit = strategy == RenderStrategyEnum::WBOIT || wboitLog;
+    if (wboit)
+    {
+        sc.sumOfColors .assign(samples, Color());
+        sc.sumOfWeights.assign(samples, 0.0f);
+        sc.revealage   .assign(samples, 1.0f);
+    }
+
+    for (auto & chunk : opaqueBins)
+        for (auto i : chunk[tile])
+        {
+            auto & p = opaquePrims[i];
+            Rasterize(p, r, pattern, [&sc, &p](int s)
+            {
+                if (p.depth > sc.depth[static_cast<size_t>(s)]) return; // GL_LEQUAL
+                sc.depth[static_cast<size_t>(s)] = p.depth;
+                sc.color[static_cast<size_t>(s)] = p.color;
+            });
+        }
+
+    for (auto & chunk : transparentBins)
+        for (auto i : chunk[tile])
+        {
+            auto & p = transparentPrims[i];
+            const float w = p.opacity;
+            auto blend = [&](auto && f)
+            {
+                Rasterize(p, r, pattern, [&](int s)
+                {
+                    auto si = static_cast<size_t>(s);
+                    if (p.depth <= sc.depth[si]) f(si); // the depth buffer isn't written
+                });
+            };
+            switch (strategy)
+            {
+            case RenderStrategyEnum::WBOIT:
+                blend([&](size_t s)
+                {
+                    auto & sum = sc.sumOfColors[s];
+                    sum.r += w * p.color.r; sum.g += w * p.color.g; sum.b += w * p.color.b;
+                    sc.sumOfWeights[s] += w; sc.revealage[s] *= 1 - w;
+                });
+                break;
+            case RenderStrategyEnum::WBOITLog: // the revealage is exp(-sumOfWeights)
+                blend([&](size_t s)
+                {
+                    const float lw = -std::log(1 - std::min(w, 0.999f));
+                    auto & sum = sc.sumOfColors[s];
+                    sum.r += lw * p.color.r; sum.g += lw * p.color.g; sum.b += lw * p.color.b;
+                    sc.sumOfWeights[s] += lw;
+                });
+                break;
+            case RenderStrategyEnum::CODB:
+                blend([&](size_t s)
+                {
+                    auto & c = sc.color[s];
+                    c.r = c.r * (1 - w) + p.color.r * w;
+                    c.g = c.g * (1 - w) + p.color.g * w;
+                    c.b = c.b * (1 - w) + p.color.b * w;
+                });
+                break;
+            case RenderStrategyEnum::Additive: // fixed point framebuffer saturates
+                blend([&](size_t s)
+                {
+                    auto & c = sc.color[s];
+                    c.r = std::min(1.0f, c.r + p.color.r * w);
+                    c.g = std::min(1.0f, c.g + p.color.g * w);
+                    c.b = std::min(1.0f, c.b + p.color.b * w);
+                });
+                break;
+            case RenderStrategyEnum::AdditiveEP:
+                blend([&](size_t s)
+                {
+                    auto & c = sc.color[s];
+                    c.r += p.color.r * w; c.g += p.color.g * w; c.b += p.color.b * w;
+                });
+                break;
+            }
+        }
+
+    // Composite per sample (as the full screen passes of WBOIT and AdditiveEP), then resolve
+    auto toByte = [](float v)
+    { return static_cast<int>(std::clamp(v, 0.0f, 1.0f) * 255 + 0.5f); };
+    for (int y = r.y0; y != r.y1; ++y)
+    {
+        auto line = reinterpret_cast<QRgb *>(bits + (height - 1 - y) * bytesPerLine);
+        for (int x = r.x0; x != r.x1; ++x)
+        {
+            Color sum;
+            auto base = (static_cast<size_t>(y - r.y0) * tileSize + (x - r.x0)) * S;
+            for (size_t s = base; s != base + static_cast<size_t>(S); ++s)
+            {
+                Color c = sc.color[s];
+                if (wboit && sc.sumOfWeights[s] != 0)
+                {
+                    float alpha = 1 - (wboitLog ? std::exp(-sc.sumOfWeights[s]) : sc.revealage[s]);
+                    float k = alpha / sc.sumOfWeights[s];
+                    auto & sumC = sc.sumOfColors[s];
+                    c = { sumC.r * k + c.r * (1 - alpha), sumC.g * k + c.g * (1 - alpha),
+                          sumC.b * k + c.b * (1 - alpha)                                  };
+                }
+                else if (strategy == RenderStrategyEnum::AdditiveEP)
+                    c = { 1 - std::exp(-0.8f * c.r), 1 - std::exp(-0.8f * c.g),
+                          1 - std::exp(-0.8f * c.b)                             };
+                sum.r += c.r; sum.g += c.g; sum.b += c.b;
+            }
+            line[x] = qRgb(toByte(sum.r / S), toByte(sum.g / S), toByte(sum.b / S));
+        }
+    }
+}
+
+SoftwareRasterizer::SoftwareRasterizer( RenderStrategyEnum strategy, int numOfSamples,
+                                        unsigned threads                               )
+    : impl(std::make_unique<Impl>(strategy, numOfSamples, threads)) {}
+
+SoftwareRasterizer::~SoftwareRasterizer() = default;
+
+QImage SoftwareRasterizer::Render(const SceneSnapshot & scene, int width, int height)
+{
+    impl->width = width; impl->height = height;
+    impl->tilesX = (width  + tileSize - 1) / tileSize;
+    impl->tilesY = (height + tileSize - 1) / tileSize;
+
+    impl->SetupPrimitives(scene);
+    impl->Bin(impl->opaquePrims     , impl->opaqueBins     );
+    impl->Bin(impl->transparentPrims, impl->transparentBins);
+
+    QImage image(width, height, QImage::Format_RGB32);
+    auto bits = image.bits(); auto bpl = image.bytesPerLine(); // detach once, not in workers
+    impl->pool.Run( static_cast<size_t>(impl->tilesX) * impl->tilesY,
+                    [this, bits, bpl](size_t tile, unsigned worker)
+                    { impl->ShadeTile(tile, worker, bits, bpl); }      );
+    return image;
+}
@@ -0,0 +1,41 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef SOFTWARERASTERIZER_H
+#define SOFTWARERASTERIZER_H
+
+#include <memory>
+#include <QImage>
+
+#include "SceneRenderer.h"
+
+struct SceneSnapshot;
+
+// CPU counterpart of SceneRenderer: renders a SceneSnapshot with any of the strategies
+// without a GPU. The screen is split into tiles, primitives are binned per tile and
+// tiles are shaded on a work-stealing ThreadPool, numOfSamples samples per pixel.
+// The result is deterministic: it doesn't depend on the count of threads.
+class SoftwareRasterizer
+{
+public:
+    using RenderStrategyEnum = SceneRenderer::RenderStrategyEnum;
+    static constexpr int tileSize = 32;
+
+    explicit SoftwareRasterizer(RenderStrategyEnum strategy, int numOfSamples, unsigned threads = 0);
+    ~SoftwareRasterizer();
+    SoftwareRasterizer(const SoftwareRasterizer & ) = delete;
+    SoftwareRasterizer(      SoftwareRasterizer &&) = delete;
+    SoftwareRasterizer & operator=(const SoftwareRasterizer & ) = delete;
+    SoftwareRasterizer & operator=(      SoftwareRasterizer &&) = delete;
+
+    // Pixel values are what the GL path leaves in its GL_SRGB8_ALPHA8 framebuffer
+    // (GL_FRAMEBUFFER_SRGB is disabled there), top row first as in QImage.
+    // Intermediate targets are float here, so they aren't quantized like in GL.
+    QImage Render(const SceneSnapshot & scene, int width, int height);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // SOFTWARERASTERIZER_H
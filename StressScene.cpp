@@ -0,0 +1,122 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "StressScene.h"
+
+#include <QStringList>
+
+#include <random>
+#include <cmath>
+
+#include "GlassWall.h"
+
+struct AnimatedWall { GlassWall * wall; float turnsPerCycle; };
+static std::vector<AnimatedWall> g_animatedWalls; // rather than FindInstance() every frame
+
+QString ParseStressSceneParams(const QString & spec, StressSceneParams & params)
+{
+    StressSceneParams p;
+    for (auto & pair : spec.split(','))
+    {
+        if (pair.trimmed().isEmpty()) continue;
+        auto kv = pair.split('=');
+        if (kv.size() != 2)
+            return QStringLiteral("Stress scene parameters must look like walls=16,triangles=10000");
+        auto key = kv[0].trimmed().toLower(), value = kv[1].trimmed();
+
+        bool ok = false;
+        if (key == QStringLiteral("walls"))
+        { p.walls = value.toInt(&ok); ok = ok && p.walls >= 1; }
+        else if (key == QStringLiteral("triangles"))
+        { p.trianglesPerWall = value.toInt(&ok); ok = ok && p.trianglesPerWall >= 1; }
+        else if (key == QStringLiteral("spread"))
+        { p.sizeSpread = value.toFloat(&ok); ok = ok && p.sizeSpread >= 1; }
+        else if (key == QStringLiteral("overlap"))
+        { p.overlap = value.toFloat(&ok); ok = ok && p.overlap > 0; }
+        else if (key == QStringLiteral("opacity"))
+        {
+            auto range = value.split(':');
+            bool ok2 = true;
+            p.minOpacity = p.maxOpacity = range[0].toFloat(&ok);
+            if (range.size() == 2) p.maxOpacity = range[1].toFloat(&ok2);
+            ok = ok && ok2 && range.size() <= 2 && p.minOpacity >= 0 && p.maxOpacity <= 1
+                 && p.minOpacity <= p.maxOpacity;
+        }
+        else if (key == QStringLiteral("seed")) p.seed = value.toUInt(&ok);
+        else return QStringLiteral("Unknown stress scene parameter: ") + key;
+
+        if (!ok) return QStringLiteral("Bad value of stress scene parameter %1: %2").arg(key, value);
+    }
+    params = p;
+    return {};
+}
+
+QString StressSceneSpec(const StressSceneParams & params)
+{
+    return QStringLiteral("walls=%1,triangles=%2,spread=%3,overlap=%4,opacity=%5:%6,seed=%7")
+           .arg(params.walls).arg(params.trianglesPerWall)
+           .arg(static_cast<double>(params.sizeSpread)).arg(static_cast<double>(params.overlap))
+           .arg(static_cast<double>(params.minOpacity)).arg(static_cast<double>(params.maxOpacity))
+           .arg(params.seed);
+}
+
+void InitStressWalls(const StressSceneParams & params)
+{
+    GlassWall::RemoveAllInstances();
+    g_animatedWalls.clear();
+
+    // A triangle of size s has area unitArea * s^2. E[s^2] for s = exp(u), u uniform in
+    // [0, ln spread], is (spread^2 - 1) / (2 ln spread); so the expected total area of all
+    // triangles is overlap times the area of the view square [-1, 1]^2
+    const double logSpread = std::log(static_cast<double>(params.sizeSpread));
+    const double meanSquare = logSpread > 0 ? (std::exp(2 * logSpread) - 1) / (2 * logSpread) : 1;
+    const double unitArea = 4.0 * params.overlap
+                            / (meanSquare * params.walls * params.trianglesPerWall);
+
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<float> coord(-1, 1), angle(0, 2 * g_pi_f), jitter(-0.5f, 0.5f);
+    std::uniform_real_distribution<double> logSize(0, logSpread);
+    std::uniform_real_distribution<float> opacity(params.minOpacity, params.maxOpacity);
+    std::uniform_real_distribution<float> turns(0.25f, 1);
+    std::uniform_int_distribution<int> channel(0, 255);
+    std::bernoulli_distribution clockwise(0.5);
+
+    for (int i = 0; i != params.walls; ++i)
+    {
+        auto & wall = GlassWall::MakeInstance(i, opacity(rng), true, true);
+        g_animatedWalls.push_back({ &wall, clockwise(rng) ? -turns(rng) : turns(rng) });
+
+        for (int t = 0; t != params.trianglesPerWall; ++t)
+        {
+            // Vertices on the unit circle about a third of the turn apart, then scaled
+            // to the area of the size drawn
+            QVector2D center(coord(rng), coord(rng));
+            float a0 = angle(rng), a1 = a0 + 2 * g_pi_f / 3 + jitter(rng),
+                                   a2 = a0 + 4 * g_pi_f / 3 + jitter(rng);
+            QVector2D v0(std::cos(a0), std::sin(a0)), v1(std::cos(a1), std::sin(a1)),
+                      v2(std::cos(a2), std::sin(a2));
+            auto e1 = v1 - v0, e2 = v2 - v0;
+            auto unitCircleArea = std::abs(e1.x() * e2.y() - e1.y() * e2.x()) / 2;
+            auto area = unitArea * std::exp(2 * logSize(rng));
+            auto r = static_cast<float>(std::sqrt(area / unitCircleArea));
+
+            // 8-bit components take the table path of sRGB conversion
+            int red = channel(rng), green = channel(rng), blue = channel(rng);
+            QColor fill(red, green, blue), edge((red + 255) / 2, (green + 255) / 2, (blue + 255) / 2);
+            wall.AddTriangle(center + r * v0, center + r * v1, center + r * v2, edge, fill);
+        }
+    }
+}
+
+void UpdateStressWalls(float p)
+{
+    for (auto & w : g_animatedWalls)
+    {
+        float angle = 2 * g_pi_f * p * w.turnsPerCycle;
+        auto cos = std::cos(angle), sin = std::sin(angle);
+        float trData [] = {  cos ,  sin , 0,
+                            -sin ,  cos , 0,
+                               0 ,    0 , 1  };
+        w.wall->Transformation(QMatrix3x3(trData));
+    }
+}
@@ -0,0 +1,31 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef STRESSSCENE_H
+#define STRESSSCENE_H
+
+#include <QString>
+
+// Random glass walls of random triangles for finding where frame time of every
+// render strategy falls off as depth complexity and triangle count grow.
+// The same parameters give the same scene.
+
+struct StressSceneParams
+{
+    int walls = 16;
+    int trianglesPerWall = 10000;
+    float sizeSpread = 10; // largest to smallest triangle size, log-uniform in between
+    float overlap = 4;     // expected count of triangles over a point of the view square
+    float minOpacity = 0.2f, maxOpacity = 0.8f; // uniform, per wall
+    unsigned seed = 1;
+};
+
+// spec looks like "walls=64,triangles=100000,spread=10,overlap=8,opacity=0.2:0.8,seed=1",
+// omitted parameters are default. Returns an error message or an empty string on success
+extern QString ParseStressSceneParams(const QString & spec, StressSceneParams & params);
+extern QString StressSceneSpec(const StressSceneParams & params); // parses back to params
+
+extern void InitStressWalls(const StressSceneParams & params); // replaces all glass walls
+extern void UpdateStressWalls(float p); // p in [0, 1] is the animation phase
+
+#endif // STRESSSCENE_H
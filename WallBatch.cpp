@@ -0,0 +1,511 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "WallBatch.h"
+
+#include <algorithm>
+
+#include "GlassWall.h"
+#include "ShaderProgram.h"
+
+// std430 layout of a wall in the shader storage buffer
+struct WallRecord
+{
+    GLfloat transformation[3][4]; // columns padded to vec4
+    GLfloat depth, opacity, padding[2];
+};
+static_assert(sizeof(WallRecord) == 64);
+
+struct WallBatch::Impl
+{
+    // PackedTriangle per triangle of all walls, and PackedInstance per instance of all walls:
+    // per instance attributes, so baseInstance of a command selects the wall as well
+    // (gl_BaseInstance needs GL 4.6)
+    AppendOnlyBuffer vertexBuffer{sizeof(PackedTriangle)}, instanceBuffer{sizeof(PackedInstance)};
+
+    bool created = false;
+    GLuint wallBuffer = 0;     // WallRecord per wall
+    GLuint commandBuffer = 0;  // edges commands, then opaque faces, then transparent faces;
+                               // for points, then the same for vertex pulling
+
+    uint64_t revision = 0, geometryRevision = 0, wallSetRevision = 0;
+    bool everUpdated = false;
+
+    std::vector<const GlassWall *> walls; // from far to near
+    // Of the vertex and instance buffers, by wall: there is room to grow after the records
+    // written, so those added to the wall later are copied straight into mapped memory.
+    // A wall that outgrows its region moves to a new one at the end of the buffers
+    struct Region
+    {
+        GLuint firstTriangle = 0, firstInstance = 0;
+        size_t triangles = 0, instances = 0; // written
+        size_t triangleCapacity = 0, instanceCapacity = 0;
+    };
+    std::vector<Region> regions;
+    size_t unusedTriangles = 0, unusedInstances = 0; // in regions walls moved away from
+    GLsizei edgeCommands = 0, opaqueCommands = 0, transparentCommands = 0;
+
+    VAO_Holder edgesVAOHolder, facesVAOHolder;
+    VAO_Holder pullingVAOHolder; // only instances: vertices read the buffer themselves
+
+    void Create();
+    void UpdateGeometry();
+    void Repack();
+    bool Place(size_t wall);
+    void Write(size_t wall);
+    void InvalidateVAOs();
+    void UpdateWalls();
+    void SetupVAO(GLuint vao, bool edges);
+    void SetupPullingVAO(GLuint vao);
+    void BindCommon(OpenGLFunctions * f, ShaderProgram & p, const QMatrix3x3 & projMat);
+    void Draw( OpenGLFunctions * f, VertexPipelineEnum pipeline, bool edges,
+               GLsizei firstCommand, GLsizei commands                       );
+};
+
+WallBatch & WallBatch::Instance() { static WallBatch ins; return ins; }
+
+bool WallBatch::IsSupported() { return HasVertexShaderStorageBlocks(); }
+
+WallBatch::WallBatch() : impl(std::make_unique<Impl>()) {}
+
+WallBatch::~WallBatch() = default;
+
+void WallBatch::Impl::Create()
+{
+    auto f = GLFunctions();
+    f->glCreateBuffers(1, &wallBuffer     );
+    f->glCreateBuffers(1, &commandBuffer  );
+    created = true;
+}
+
+void WallBatch::Impl::InvalidateVAOs()
+{
+    edgesVAOHolder.Invalidate(); facesVAOHolder.Invalidate(); pullingVAOHolder.Invalidate();
+}
+
+// A region with twice the room the records of the wall take, at the end of the buffers,
+// so a wall that keeps growing moves a logarithmic number of times; true if a buffer
+// was recreated
+bool WallBatch::Impl::Place(size_t wall)
+{
+    static constexpr size_t minCapacity = 16;
+    auto & r = regions[wall];
+    r.firstTriangle = static_cast<GLuint>(vertexBuffer  .Count());
+    r.firstInstance = static_cast<GLuint>(instanceBuffer.Count());
+    r.triangles = r.instances = 0;
+    r.triangleCapacity = std::max(2 * walls[wall]->PackedTriangles().size(), minCapacity);
+    r.instanceCapacity = std::max(2 * walls[wall]->PackedInstances().size(), minCapacity);
+    bool recreated = vertexBuffer.Append(r.triangleCapacity);
+    return instanceBuffer.Append(r.instanceCapacity) || recreated;
+}
+
+// Records of the wall not written yet: the rest of its region isn't read by any draw,
+// so they are copied into the persistent mapping without synchronization
+void WallBatch::Impl::Write(size_t wall)
+{
+    auto & r = regions[wall];
+    auto t = walls[wall]->PackedTriangles();
+    auto n = walls[wall]->PackedInstances();
+    std::copy( t.begin() + r.triangles, t.end(),
+               static_cast<PackedTriangle *>(vertexBuffer.Records(r.firstTriangle + r.triangles)) );
+    auto out = static_cast<PackedInstance *>(instanceBuffer.Records(r.firstInstance + r.instances));
+    for (auto it = n.begin() + r.instances; it != n.end(); ++it)
+    { *out = *it; (out++)->wall = static_cast<GLuint>(wall); }
+    r.triangles = t.size(); r.instances = n.size();
+}
+
+// Geometry of walls is append-only, so with the same set of walls only records added since
+// the last call are written. A new set of walls, or regions left behind taking more than
+// half of a buffer, packs all walls into new storage
+void WallBatch::Impl::UpdateGeometry()
+{
+    if (!everUpdated || wallSetRevision != GlassWall::WallSetRevision()) { Repack(); return; }
+
+    std::vector<size_t> outgrown;
+    auto unusedT = unusedTriangles, unusedI = unusedInstances;
+    for (size_t i = 0; i != walls.size(); ++i)
+        if (   walls[i]->PackedTriangles().size() > regions[i].triangleCapacity
+            || walls[i]->PackedInstances().size() > regions[i].instanceCapacity)
+        {
+            outgrown.push_back(i);
+            unusedT += regions[i].triangleCapacity; unusedI += regions[i].instanceCapacity;
+        }
+    if (2 * unusedT > vertexBuffer.Count() || 2 * unusedI > instanceBuffer.Count())
+    { Repack(); return; }
+
+    // Walls that fit first: a buffer recreated by Place() gets their records by a GPU copy,
+    // which would overwrite records written into it before the copy runs
+    for (size_t i = 0, k = 0; i != walls.size(); ++i)
+        if (k != outgrown.size() && outgrown[k] == i) ++k; else Write(i);
+    bool recreated = false;
+    for (auto i : outgrown)
+    {
+        recreated = Place(i) || recreated;
+        Write(i);
+    }
+    unusedTriangles = unusedT; unusedInstances = unusedI;
+    if (recreated) InvalidateVAOs();
+}
+
+void WallBatch::Impl::Repack()
+{
+    walls.clear();
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); !iter.AtEnd(); ++iter) walls.push_back(&*iter);
+    regions.assign(walls.size(), Region());
+    unusedTriangles = unusedInstances = 0;
+
+    // Draws in flight keep reading the old storage
+    vertexBuffer.Reset(); instanceBuffer.Reset();
+    for (size_t i = 0; i != walls.size(); ++i) { Place(i); Write(i); }
+    InvalidateVAOs();
+}
+
+void WallBatch::Impl::UpdateWalls()
+{
+    std::vector<WallRecord> records(walls.size());
+    std::vector<DrawArraysIndirectCommand> edges, opaque, transparent;
+    for (size_t i = 0; i != walls.size(); ++i)
+    {
+        auto & wall = *walls[i];
+        auto & r = records[i];
+        auto tr = wall.Transformation();
+        for (int col = 0; col != 3; ++col)
+            for (int row = 0; row != 3; ++row) r.transformation[col][row] = tr(row, col);
+        r.depth = wall.Depth(); r.opacity = wall.Opacity();
+
+        if (!wall.Visible()) continue;
+        for (auto cmd : wall.DrawCommands())
+        {
+            cmd.first += regions[i].firstTriangle; cmd.baseInstance += regions[i].firstInstance;
+            edges.push_back(cmd);
+            (wall.Transparent() ? transparent : opaque).push_back(cmd);
+        }
+    }
+    edgeCommands        = static_cast<GLsizei>(edges      .size());
+    opaqueCommands      = static_cast<GLsizei>(opaque     .size());
+    transparentCommands = static_cast<GLsizei>(transparent.size());
+    edges.insert(edges.end(), opaque     .begin(), opaque     .end());
+    edges.insert(edges.end(), transparent.begin(), transparent.end());
+    // Vertex pulling draws 3 vertices per triangle, gl_VertexID counts from first
+    for (size_t i = 0, n = edges.size(); i != n; ++i)
+    {
+        auto cmd = edges[i];
+        cmd.count *= 3; cmd.first *= 3;
+        edges.push_back(cmd);
+    }
+
+    auto f = GLFunctions();
+    f->glNamedBufferData( wallBuffer, static_cast<GLsizeiptr>(records.size() * sizeof(WallRecord)),
+                          records.data(), GL_DYNAMIC_DRAW );
+    f->glNamedBufferData( commandBuffer,
+                          static_cast<GLsizeiptr>(edges.size() * sizeof(DrawArraysIndirectCommand)),
+                          edges.data(), GL_DYNAMIC_DRAW );
+}
+
+void WallBatch::Update()
+{
+    if (!impl->created) impl->Create();
+    bool geometryChanged = !impl->everUpdated
+                           || impl->geometryRevision != GlassWall::GeometryRevision();
+    if (geometryChanged) impl->UpdateGeometry();
+    if (geometryChanged || impl->revision != GlassWall::Revision()) impl->UpdateWalls();
+    impl->geometryRevision = GlassWall::GeometryRevision();
+    impl->wallSetRevision = GlassWall::WallSetRevision();
+    impl->revision = GlassWall::Revision();
+    impl->everUpdated = true;
+}
+
+void WallBatch::Impl::SetupVAO(GLuint vao, bool edges)
+{
+    auto f = GLFunctions();
+    f->glBindVertexArray(vao);
+
+    f->glBindVertexBuffer(0, vertexBuffer.Buffer(), 0, sizeof(PackedTriangle));
+    SetupTriangleAttributes(f, 0, edges);
+    f->glBindVertexBuffer(1, instanceBuffer.Buffer(), 0, sizeof(PackedInstance));
+    SetupInstanceAttributes(f, 1);
+
+    (edges ? edgesVAOHolder : facesVAOHolder).VAO_SetReady();
+}
+
+void WallBatch::Impl::SetupPullingVAO(GLuint vao)
+{
+    auto f = GLFunctions();
+    f->glBindVertexArray(vao);
+
+    f->glBindVertexBuffer(1, instanceBuffer.Buffer(), 0, sizeof(PackedInstance));
+    SetupInstanceAttributes(f, 1);
+
+    pullingVAOHolder.VAO_SetReady();
+}
+
+
+
+struct WallBatch_GLProgram {
+    ShaderProgram p;
+    static constexpr auto vs_source =
+            "#version 450 core                                                                 \n"
+            "layout (location = 0) in vec2 vertex0;                                            \n"
+            "layout (location = 1) in vec2 vertex1;                                            \n"
+            "layout (location = 2) in vec2 vertex2;                                            \n"
+            "layout (location = 3) in vec3 color;                                              \n"
+            "layout (location = 4) in uint wall;                                               \n"
+            "layout (location = 5) in vec3 instanceTr0; // rows of the transformation          \n"
+            "layout (location = 6) in vec3 instanceTr1;                                        \n"
+            "layout (location = 7) in vec3 instanceEdgeColor;                                  \n"
+            "layout (location = 8) in vec3 instanceFillColor;                                  \n"
+            "layout (location = 9) in uint ownColors;                                          \n"
+            "                                                                                  \n"
+            "struct Wall { vec4 tr0, tr1, tr2; vec4 params; }; // depth, opacity               \n"
+            "layout (std430, binding = 0) readonly buffer Walls { Wall walls[]; };             \n"
+            "                                                                                  \n"
+            "layout (location = 0) uniform mat3 projMat;                                       \n"
+            "layout (location = 1) uniform bool edges;                                         \n"
+            "                                                                                  \n"
+            "out vec4 gs_vertex0;                                                              \n"
+            "out vec4 gs_vertex1;                                                              \n"
+            "out vec4 gs_vertex2;                                                              \n"
+            "out vec3 gs_color;                                                                \n"
+            "out float gs_opacity;                                                             \n"
+            "                                                                                  \n"
+            "void main()                                                                       \n"
+            "{                                                                                 \n"
+            "    Wall w = walls[wall];                                                         \n"
+            "    mat3 tr = projMat * mat3(w.tr0.xyz, w.tr1.xyz, w.tr2.xyz)                     \n"
+            "                      * transpose(mat3(instanceTr0, instanceTr1, vec3(0, 0, 1))); \n"
+            "    float d = w.params.x;                                                         \n"
+            "    gs_vertex0 = vec4((tr * vec3(vertex0, 1)).xy, d, 1);                          \n"
+            "    gs_vertex1 = vec4((tr * vec3(vertex1, 1)).xy, d, 1);                          \n"
+            "    gs_vertex2 = vec4((tr * vec3(vertex2, 1)).xy, d, 1);                          \n"
+            "    gs_color = ownColors != 0 ? color                                             \n"
+            "                              : edges ? instanceEdgeColor : instanceFillColor;    \n"
+            "    gs_opacity = w.params.y;                                                      \n"
+            "}                                                                                 \n";
+    static constexpr auto gs_source =
+            "#version 450 core                                                     \n"
+            "layout (points) in;                                                   \n"
+            "layout (triangle_strip, max_vertices = 3) out;                        \n"
+            "                                                                      \n"
+            "in vec4 gs_vertex0[];                                                 \n"
+            "in vec4 gs_vertex1[];                                                 \n"
+            "in vec4 gs_vertex2[];                                                 \n"
+            "in vec3 gs_color[];                                                   \n"
+            "in float gs_opacity[];                                                \n"
+            "                                                                      \n"
+            "out flat vec3 fs_color;                                               \n"
+            "out flat float fs_opacity;                                            \n"
+            "                                                                      \n"
+            "void main()                                                           \n"
+            "{                                                                     \n"
+            "    fs_color = gs_color[0]; fs_opacity = gs_opacity[0];               \n"
+            "    gl_Position = gs_vertex0[0]; EmitVertex();                        \n"
+            "    fs_color = gs_color[0]; fs_opacity = gs_opacity[0];               \n"
+            "    gl_Position = gs_vertex1[0]; EmitVertex();                        \n"
+            "    fs_color = gs_color[0]; fs_opacity = gs_opacity[0];               \n"
+            "    gl_Position = gs_vertex2[0]; EmitVertex();                        \n"
+            "    EndPrimitive();                                                   \n"
+            "}                                                                     \n";
+    // Vertex pulling: 3 vertices per triangle, no geometry shader. PackedTriangle records
+    // are 9 uints: 6 floats, then fill RG, fill B + edge R, edge GB
+    static constexpr auto vs_source_pulling =
+            "#version 450 core                                                             \n"
+            "layout (location = 4) in uint wall;                                           \n"
+            "layout (location = 5) in vec3 instanceTr0; // rows of the transformation      \n"
+            "layout (location = 6) in vec3 instanceTr1;                                    \n"
+            "layout (location = 7) in vec3 instanceEdgeColor;                              \n"
+            "layout (location = 8) in vec3 instanceFillColor;                              \n"
+            "layout (location = 9) in uint ownColors;                                      \n"
+            "                                                                              \n"
+            "struct Wall { vec4 tr0, tr1, tr2; vec4 params; }; // depth, opacity           \n"
+            "layout (std430, binding = 0) readonly buffer Walls { Wall walls[]; };         \n"
+            "layout (std430, binding = 1) readonly buffer Triangles { uint t[]; };         \n"
+            "                                                                              \n"
+            "layout (location = 0) uniform mat3 projMat;                                   \n"
+            "layout (location = 1) uniform bool edges;                                     \n"
+            "                                                                              \n"
+            "out flat vec3 fs_color;                                                       \n"
+            "out flat float fs_opacity;                                                    \n"
+            "                                                                              \n"
+            "void main()                                                                   \n"
+            "{                                                                             \n"
+            "    Wall w = walls[wall];                                                     \n"
+            "    mat3 tr = projMat * mat3(w.tr0.xyz, w.tr1.xyz, w.tr2.xyz);                \n"
+            "    int i = 9 * (gl_VertexID / 3), v = i + 2 * (gl_VertexID % 3);             \n"
+            "    vec3 vertex = vec3(uintBitsToFloat(uvec2(t[v], t[v + 1])), 1);            \n"
+            "    vertex.xy = vec2(dot(instanceTr0, vertex), dot(instanceTr1, vertex));     \n"
+            "    gl_Position = vec4((tr * vertex).xy, w.params.x, 1);                      \n"
+            "    vec2 c0 = unpackUnorm2x16(t[i + 6]), c1 = unpackUnorm2x16(t[i + 7]),      \n"
+            "         c2 = unpackUnorm2x16(t[i + 8]);                                      \n"
+            "    fs_color = ownColors == 0 ? edges ? instanceEdgeColor : instanceFillColor \n"
+            "                              : edges ? vec3(c1.y, c2)    : vec3(c0, c1.x);   \n"
+            "    fs_opacity = w.params.y;                                                  \n"
+            "}                                                                             \n";
+    static constexpr auto fs_source_NT =
+            "#version 450 core                 \n"
+            "                                  \n"
+            "in flat vec3 fs_color;            \n"
+            "out vec3 color;                   \n"
+            "                                  \n"
+            "void main() { color = fs_color; } \n";
+    static constexpr auto fs_source_WBOIT =
+            "#version 450 core                                                     \n"
+            "layout (early_fragment_tests) in;                                     \n"
+            "                                                                      \n"
+            "in flat vec3 fs_color;                                                \n"
+            "in flat float fs_opacity;                                             \n"
+            "                                                                      \n"
+            "layout (location = 0) out vec4 outData;                               \n"
+            "layout (location = 1) out float alpha;                                \n"
+            "layout (binding = 0, r8ui) uniform writeonly uimage2D tileMask;       \n"
+            "                                                                      \n"
+            "void main()                                                           \n"
+            "{                                                                     \n"
+            "    float w = fs_opacity;                                             \n"
+            "    outData = vec4(w * fs_color, w); alpha = 1 - w;                   \n"
+            "    imageStore(tileMask, ivec2(gl_FragCoord.xy) / 16, uvec4(1));      \n"
+            "}                                                                     \n";
+    // See GlassWall_GLProgram
+    static constexpr auto fs_source_WBOITLog =
+            "#version 450 core                                                     \n"
+            "layout (early_fragment_tests) in;                                     \n"
+            "                                                                      \n"
+            "in flat vec3 fs_color;                                                \n"
+            "in flat float fs_opacity;                                             \n"
+            "                                                                      \n"
+            "layout (location = 0) out vec4 outData;                               \n"
+            "layout (binding = 0, r8ui) uniform writeonly uimage2D tileMask;       \n"
+            "                                                                      \n"
+            "void main()                                                           \n"
+            "{                                                                     \n"
+            "    float w = -log(1 - min(fs_opacity, 0.999));                       \n"
+            "    outData = vec4(w * fs_color, w);                                  \n"
+            "    imageStore(tileMask, ivec2(gl_FragCoord.xy) / 16, uvec4(1));      \n"
+            "}                                                                     \n";
+    static constexpr auto fs_source_CODB =
+            "#version 450 core                                   \n"
+            "                                                    \n"
+            "in flat vec3 fs_color;                              \n"
+            "in flat float fs_opacity;                           \n"
+            "out vec4 color;                                     \n"
+            "                                                    \n"
+            "void main() { color = vec4(fs_color, fs_opacity); } \n";
+    static constexpr auto fs_source_Additive =
+            "#version 450 core                                    \n"
+            "                                                     \n"
+            "in flat vec3 fs_color;                               \n"
+            "in flat float fs_opacity;                            \n"
+            "out vec3 color;                                      \n"
+            "                                                     \n"
+            "void main() { color = vec3(fs_color * fs_opacity); } \n";
+
+    enum class Mode { NT, WBOIT, WBOITLog, CODB, Additive };
+    explicit WallBatch_GLProgram(Mode mode, VertexPipelineEnum pipeline)
+    {
+        if (pipeline == VertexPipelineEnum::VertexPulling)
+        {
+            p.AddShader(GL_VERTEX_SHADER, vs_source_pulling);
+        }
+        else
+        {
+            p.AddShader(GL_VERTEX_SHADER  , vs_source);
+            p.AddShader(GL_GEOMETRY_SHADER, gs_source);
+        }
+        auto fs = mode == Mode::NT       ? fs_source_NT
+                : mode == Mode::WBOIT    ? fs_source_WBOIT
+                : mode == Mode::WBOITLog ? fs_source_WBOITLog
+                : mode == Mode::CODB     ? fs_source_CODB
+                                         : fs_source_Additive;
+        p.AddShader(GL_FRAGMENT_SHADER, fs);
+        p.Link();
+    }
+
+    static ShaderProgram & Get(Mode mode, VertexPipelineEnum pipeline)
+    {
+        auto variant = 2 * static_cast<uint32_t>(mode) + static_cast<uint32_t>(pipeline);
+        return GLProgram<WallBatch_GLProgram>(variant, mode, pipeline).p;
+    }
+    static ShaderProgram & Get(WallBatch::TransparentMode mode, VertexPipelineEnum pipeline)
+    {
+        using TransparentMode = WallBatch::TransparentMode;
+        return Get( mode == TransparentMode::WBOIT    ? Mode::WBOIT
+                  : mode == TransparentMode::WBOITLog ? Mode::WBOITLog
+                  : mode == TransparentMode::CODB     ? Mode::CODB
+                                                      : Mode::Additive, pipeline );
+    }
+};
+
+void WallBatch::Impl::BindCommon( OpenGLFunctions * f, ShaderProgram & p,
+                                  const QMatrix3x3 & projMat                     )
+{
+    if (!p.Bind()) assert(false);
+    f->glUniformMatrix3fv(0, 1, GL_FALSE, projMat.constData());
+
+    f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, wallBuffer);
+    f->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+    f->glEnable(GL_DEPTH_TEST);
+    f->glEnable(GL_MULTISAMPLE);
+    f->glDepthFunc(GL_LEQUAL);
+}
+
+static const void * CommandOffset(GLsizei commands)
+{
+    return reinterpret_cast<const void *>(commands * sizeof(DrawArraysIndirectCommand));
+}
+
+void WallBatch::Impl::Draw( OpenGLFunctions * f, VertexPipelineEnum pipeline, bool edges,
+                            GLsizei firstCommand, GLsizei commands                       )
+{
+    if (pipeline == VertexPipelineEnum::VertexPulling)
+    {
+        auto [vao, ready] = pullingVAOHolder.GetVAO();
+        if (!ready) SetupPullingVAO(vao); else f->glBindVertexArray(vao);
+        f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vertexBuffer.Buffer());
+        f->glUniform1i(1, edges);
+        auto pointCommands = edgeCommands + opaqueCommands + transparentCommands;
+        f->glMultiDrawArraysIndirect( GL_TRIANGLES, CommandOffset(pointCommands + firstCommand),
+                                      commands, 0                                              );
+        return;
+    }
+    auto [vao, ready] = (edges ? edgesVAOHolder : facesVAOHolder).GetVAO();
+    if (!ready) SetupVAO(vao, edges); else f->glBindVertexArray(vao);
+    f->glUniform1i(1, edges);
+    f->glMultiDrawArraysIndirect(GL_POINTS, CommandOffset(firstCommand), commands, 0);
+}
+
+std::vector<ShaderProgram *> WallBatch::Programs( VertexPipelineEnum pipeline,
+                                                 TransparentMode mode         )
+{
+    return { &WallBatch_GLProgram::Get(WallBatch_GLProgram::Mode::NT, pipeline),
+             &WallBatch_GLProgram::Get(mode, pipeline)                          };
+}
+
+void WallBatch::DrawNonTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                    VertexPipelineEnum pipeline                     )
+{
+    assert(impl->everUpdated);
+    if (!impl->edgeCommands) return;
+
+    auto & p = WallBatch_GLProgram::Get(WallBatch_GLProgram::Mode::NT, pipeline);
+    impl->BindCommon(f, p, projMat);
+
+    // Edges of all walls first: faces of a nearer wall are drawn after edges
+    // of farther ones anyway, and the depth test hides farther faces behind nearer edges
+    f->glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    impl->Draw(f, pipeline, true, 0, impl->edgeCommands);
+    f->glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    if (impl->opaqueCommands)
+        impl->Draw(f, pipeline, false, impl->edgeCommands, impl->opaqueCommands);
+}
+
+void WallBatch::DrawTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                                 VertexPipelineEnum pipeline, TransparentMode mode )
+{
+    assert(impl->everUpdated);
+    if (!impl->transparentCommands) return;
+
+    impl->BindCommon(f, WallBatch_GLProgram::Get(mode, pipeline), projMat);
+    impl->Draw( f, pipeline, false, impl->edgeCommands + impl->opaqueCommands,
+                impl->transparentCommands                                    );
+}
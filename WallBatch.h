@@ -0,0 +1,52 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef WALLBATCH_H
+#define WALLBATCH_H
+
+#include <memory>
+#include <vector>
+#include <QGenericMatrix>
+
+#include "GLDrawingFacilities.h"
+
+class ShaderProgram;
+
+// Draws all glass walls at once: triangles of all walls are in one persistently mapped
+// vertex buffer, each wall in a region with room to grow, so triangles added to walls
+// are copied in place,
+// depth, opacity and transformation of every wall are in a shader storage buffer,
+// and every pass is a single glMultiDrawArraysIndirect with a command per wall.
+// Buffers are shared by all contexts, VAOs are per context.
+class WallBatch
+{
+public:
+    enum class TransparentMode { WBOIT, WBOITLog, CODB, Additive }; // see SceneRenderer
+
+    static WallBatch & Instance();
+    static bool IsSupported(); // needs shader storage blocks in vertex shaders
+    // Like GlassWall::Programs()
+    static std::vector<ShaderProgram *> Programs( VertexPipelineEnum pipeline,
+                                                  TransparentMode mode         );
+
+    ~WallBatch();
+    WallBatch(const WallBatch & ) = delete;
+    WallBatch(      WallBatch &&) = delete;
+    WallBatch & operator=(const WallBatch & ) = delete;
+    WallBatch & operator=(      WallBatch &&) = delete;
+
+    void Update(); // re-uploads what changed in walls since the last call
+
+    // Same output as GlassWall::Draw* called for every wall from far to near
+    void DrawNonTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                             VertexPipelineEnum pipeline                     );
+    void DrawTransparent( OpenGLFunctions * f, const QMatrix3x3 & projMat,
+                          VertexPipelineEnum pipeline, TransparentMode mode );
+
+private:
+    explicit WallBatch();
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // WALLBATCH_H
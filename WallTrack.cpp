@@ -0,0 +1,220 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "WallTrack.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "GlassWall.h"
+
+// File: "WallTrack 1 <count of walls>", then a line per change:
+// "<milliseconds> <wall> <field> <values>", the state of every wall at 0 first
+namespace {
+
+enum Field { Transformation, Opacity, Visible, Transparent, DepthLevel, FieldCount };
+const char * const g_fieldNames [] = { "transformation", "opacity", "visible",
+                                       "transparent", "depth"                  };
+constexpr int g_fieldSizes [] = { 9, 1, 1, 1, 1 };
+
+using Values = std::array<float, 9>; // row-major matrix, or a single value first
+using WallState = std::array<Values, FieldCount>;
+
+std::vector<GlassWall *> WallsFarToNear()
+{
+    std::vector<GlassWall *> ret;
+    ret.reserve(GlassWall::CountOfInstances());
+    auto & iter = GlassWallIterator::Instance();
+    for (iter.Reset(); !iter.AtEnd(); ++iter) ret.push_back(&*iter);
+    return ret;
+}
+
+Values Get(const GlassWall & wall, int field)
+{
+    Values ret{};
+    switch (field)
+    {
+    case Transformation:
+    {
+        auto tr = wall.Transformation();
+        for (int row = 0; row != 3; ++row)
+            for (int col = 0; col != 3; ++col) ret[3 * row + col] = tr(row, col);
+        break;
+    }
+    case Opacity    : ret[0] = wall.Opacity(); break;
+    case Visible    : ret[0] = wall.Visible    () ? 1 : 0; break;
+    case Transparent: ret[0] = wall.Transparent() ? 1 : 0; break;
+    case DepthLevel : ret[0] = static_cast<float>(wall.DepthLevel()); break;
+    default: assert(false);
+    }
+    return ret;
+}
+
+// Walls are only touched where they differ, so revisions don't change for nothing
+void Set(GlassWall & wall, int field, const Values & v)
+{
+    if (Get(wall, field) == v) return;
+    switch (field)
+    {
+    case Transformation: wall.Transformation(QMatrix3x3(v.data())); break;
+    case Opacity       : wall.Opacity(v[0]); break;
+    case Visible       : wall.Visible    (v[0] != 0); break;
+    case Transparent   : wall.Transparent(v[0] != 0); break;
+    case DepthLevel    : wall.DepthLevel(static_cast<int>(v[0])); break;
+    default: assert(false);
+    }
+}
+
+} // namespace
+
+struct WallTrackRecorder::Impl
+{
+    struct Change { double ms; uint32_t wall; int field; Values values; };
+
+    QElapsedTimer sinceStart;
+    std::vector<WallState> last; // of every wall
+    std::vector<Change> changes;
+};
+
+WallTrackRecorder::WallTrackRecorder() : impl(std::make_unique<Impl>())
+{
+    auto walls = WallsFarToNear();
+    impl->last.resize(walls.size());
+    for (uint32_t i = 0; i != walls.size(); ++i)
+        for (int field = 0; field != FieldCount; ++field)
+        {
+            impl->last[i][field] = Get(*walls[i], field);
+            impl->changes.push_back({ 0, i, field, impl->last[i][field] });
+        }
+    impl->sinceStart.start();
+}
+
+WallTrackRecorder::~WallTrackRecorder() = default;
+
+void WallTrackRecorder::Capture()
+{
+    auto ms = static_cast<double>(impl->sinceStart.nsecsElapsed()) * 1e-6;
+    auto walls = WallsFarToNear();
+    if (walls.size() != impl->last.size()) return; // another scene: nothing to match
+    for (uint32_t i = 0; i != walls.size(); ++i)
+        for (int field = 0; field != FieldCount; ++field)
+        {
+            auto v = Get(*walls[i], field);
+            if (v == impl->last[i][field]) continue;
+            impl->last[i][field] = v;
+            impl->changes.push_back({ ms, i, field, v });
+        }
+}
+
+QString WallTrackRecorder::Save(const QString & path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return QStringLiteral("Can't open %1: %2").arg(path, file.errorString());
+    QTextStream out(&file);
+    out << "WallTrack 1 " << impl->last.size() << '\n';
+    for (auto & c : impl->changes)
+    {
+        out << QString::number(c.ms, 'f', 3) << ' ' << c.wall << ' ' << g_fieldNames[c.field];
+        for (int k = 0; k != g_fieldSizes[c.field]; ++k)
+            out << ' ' << QString::number(static_cast<double>(c.values[k]), 'g', 9); // exact
+        out << '\n';
+    }
+    out.flush();
+    if (file.error() != QFileDevice::NoError)
+        return QStringLiteral("Can't write %1: %2").arg(path, file.errorString());
+    return {};
+}
+
+
+
+struct WallTrack::Impl
+{
+    struct Key { double ms; Values values; };
+    std::vector<std::array<std::vector<Key>, FieldCount>> walls; // keys sorted by time
+    double duration = 0;
+};
+
+WallTrack::WallTrack() : impl(std::make_unique<Impl>()) {}
+
+WallTrack::~WallTrack() = default;
+
+QString WallTrack::Load(const QString & path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return QStringLiteral("Can't open %1: %2").arg(path, file.errorString());
+    QTextStream in(&file);
+
+    auto broken = [&path](int line)
+    { return QStringLiteral("%1:%2: not a wall track or broken").arg(path).arg(line); };
+    auto header = in.readLine().split(' ');
+    bool ok = header.size() == 3 && header[0] == QStringLiteral("WallTrack")
+              && header[1] == QStringLiteral("1");
+    auto wallCount = ok ? header[2].toUInt(&ok) : 0;
+    if (!ok || wallCount > file.size()) return broken(1); // a line per wall at least
+
+    Impl loaded;
+    loaded.walls.resize(wallCount);
+    for (int line = 2; !in.atEnd(); ++line)
+    {
+        auto parts = in.readLine().split(' ');
+        if (parts.size() == 1 && parts[0].isEmpty()) continue;
+        if (parts.size() < 4) return broken(line);
+
+        Impl::Key key{};
+        key.ms = parts[0].toDouble(&ok);
+        if (!ok || !(key.ms >= 0)) return broken(line);
+        auto wall = parts[1].toUInt(&ok);
+        if (!ok || wall >= wallCount) return broken(line);
+        int field = 0;
+        while (field != FieldCount && parts[2] != QLatin1String(g_fieldNames[field])) ++field;
+        if (field == FieldCount) return broken(line);
+        if (parts.size() != 3 + g_fieldSizes[field]) return broken(line);
+        for (int k = 0; k != g_fieldSizes[field]; ++k)
+        {
+            key.values[k] = parts[3 + k].toFloat(&ok);
+            if (!ok) return broken(line);
+        }
+        if (field == Opacity && (key.values[0] < 0 || key.values[0] > 1)) return broken(line);
+
+        loaded.walls[wall][field].push_back(key);
+        loaded.duration = std::max(loaded.duration, key.ms);
+    }
+
+    for (auto & wall : loaded.walls)
+        for (auto & keys : wall)
+            std::stable_sort( keys.begin(), keys.end(),
+                              [](const Impl::Key & a, const Impl::Key & b)
+                              { return a.ms < b.ms; }                      );
+    *impl = std::move(loaded);
+    return {};
+}
+
+bool WallTrack::FitsScene() const { return impl->walls.size() == GlassWall::CountOfInstances(); }
+
+double WallTrack::Duration() const { return impl->duration; }
+
+int WallTrack::FrameCount(double stepMs) const
+{ return static_cast<int>(std::floor(impl->duration / stepMs)) + 1; }
+
+void WallTrack::Apply(double ms) const
+{
+    assert(FitsScene());
+    auto walls = WallsFarToNear();
+    for (size_t i = 0; i != walls.size(); ++i)
+        for (int field = 0; field != FieldCount; ++field)
+        {
+            auto & keys = impl->walls[i][field];
+            auto it = std::upper_bound( keys.cbegin(), keys.cend(), ms,
+                                        [](double t, const Impl::Key & k){ return t < k.ms; } );
+            if (it != keys.cbegin()) Set(*walls[i], field, std::prev(it)->values);
+        }
+}
@@ -0,0 +1,55 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#ifndef WALLTRACK_H
+#define WALLTRACK_H
+
+#include <QString>
+#include <memory>
+
+// Timestamped changes of transformation, opacity, visibility, transparency and depth level
+// of glass walls, recorded from whatever drives them and played back at a fixed frame step,
+// so runs see the same frames whatever the build or the speed of the machine.
+// Walls are identified by their place from far to near when recording started, so a track
+// plays back on the scene it was recorded with. Track files are text, a change per line.
+
+class WallTrackRecorder
+{
+public:
+    explicit WallTrackRecorder(); // records the state of all walls at time 0
+    ~WallTrackRecorder();
+    WallTrackRecorder(const WallTrackRecorder & ) = delete;
+    WallTrackRecorder(      WallTrackRecorder &&) = delete;
+    WallTrackRecorder & operator=(const WallTrackRecorder & ) = delete;
+    WallTrackRecorder & operator=(      WallTrackRecorder &&) = delete;
+
+    void Capture(); // records what changed since the last call, timestamped from construction
+    QString Save(const QString & path) const; // returns an error message or an empty string
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+class WallTrack
+{
+public:
+    explicit WallTrack();
+    ~WallTrack();
+    WallTrack(const WallTrack & ) = delete;
+    WallTrack(      WallTrack &&) = delete;
+    WallTrack & operator=(const WallTrack & ) = delete;
+    WallTrack & operator=(      WallTrack &&) = delete;
+
+    QString Load(const QString & path); // returns an error message or an empty string
+    bool FitsScene() const; // the track has as many walls as the scene
+    double Duration() const; // milliseconds up to the last change
+    int FrameCount(double stepMs) const; // frames at the step showing the whole track
+
+    // Sets every wall to its state at the time; needs FitsScene()
+    void Apply(double ms) const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif // WALLTRACK_H
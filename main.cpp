@@ -4,14 +4,86 @@
 #include "mainwindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QSurfaceFormat>
+
+#include <cstdio>
+#include <cstring>
+
+#include "Benchmark.h"
+#include "ErrorAnalyzer.h"
+#include "GLDrawingFacilities.h"
+#include "StressScene.h"
+
+static bool ArgumentPassed(int argc, char * argv[], const char * arg)
+{
+    for (int i = 1; i < argc; ++i) if (std::strcmp(argv[i], arg) == 0) return true;
+    return false;
+}
 
 int main(int argc, char *argv[])
 {
+    const bool bench = BenchmarkRequested(argc, argv);
+    const bool analyze = ErrorAnalysisRequested(argc, argv);
+    if (bench || analyze) PrepareHeadlessPlatform();
+    EnableGLContextSharing();
+    if (ArgumentPassed(argc, argv, "--no-vsync")) // the format of windows is chosen early
+    {
+        auto format = QSurfaceFormat::defaultFormat();
+        format.setSwapInterval(0);
+        QSurfaceFormat::setDefaultFormat(format);
+    }
+    if (ArgumentPassed(argc, argv, "--no-shader-cache"))
+        QCoreApplication::setAttribute(Qt::AA_DisableShaderDiskCache);
+
     QApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("A simple project for experimenting with WBOIT"));
+    parser.addHelpOption();
+    AddBenchmarkOptions(parser);
+    AddErrorAnalyzerOptions(parser);
+    parser.addOption({ QStringLiteral("stress-scene"),
+                       QStringLiteral("Show or benchmark random glass walls instead of the demo "
+                                      "scene, e.g. walls=16,triangles=10000,spread=10,overlap=4,"
+                                      "opacity=0.2:0.8,seed=1 (spread is the ratio of the largest "
+                                      "triangle size to the smallest, overlap is the mean count "
+                                      "of triangles over a point)."),
+                       QStringLiteral("spec") });
+    parser.addOption({ QStringLiteral("scene-file"),
+                       QStringLiteral("Show or benchmark the glass walls of a scene file saved "
+                                      "from the Scene menu instead of the demo scene."),
+                       QStringLiteral("path") });
+    parser.addOption({ QStringLiteral("no-vsync"),
+                       QStringLiteral("Don't wait for vertical sync, e.g. to play a wall track "
+                                      "as fast as frames are drawn.") });
+    parser.addOption({ QStringLiteral("no-shader-cache"),
+                       QStringLiteral("Compile shaders from source rather than loading program "
+                                      "binaries cached by previous runs.") });
+    parser.process(a);
+
+    if (bench) return RunBenchmark(parser);
+    if (analyze) return RunErrorAnalysis(parser);
+
+    StressSceneParams stressScene;
+    if (parser.isSet(QStringLiteral("stress-scene")))
+    {
+        auto error = ParseStressSceneParams( parser.value(QStringLiteral("stress-scene")),
+                                             stressScene                                  );
+        if (!error.isEmpty())
+        { QTextStream(stderr) << "--stress-scene: " << error << '\n'; return 1; }
+    }
+
     MainWindow w;
     w.show();
-    w.InitWalls();
+    if (parser.isSet(QStringLiteral("scene-file")))
+    {
+        auto error = w.LoadWalls(parser.value(QStringLiteral("scene-file")));
+        if (!error.isEmpty()) { QTextStream(stderr) << error << '\n'; return 1; }
+    }
+    else if (parser.isSet(QStringLiteral("stress-scene"))) w.InitStressWalls(stressScene);
+    else w.InitWalls();
 
     return a.exec();
 }
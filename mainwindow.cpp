@@ -9,9 +9,22 @@
 #include <QLabel>
 #include <QCheckBox>
 #include <QSplitter>
+#include <QStatusBar>
+#include <QMenuBar>
+#include <QActionGroup>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QFileDialog>
+
+#include <optional>
 
 #include "GLWidget.h"
 #include "GlassWall.h"
+#include "DemoScene.h"
+#include "StressScene.h"
+#include "SceneFile.h"
+#include "WallTrack.h"
+#include "RenderScheduler.h"
 
 struct MainWindow::Impl
 {
@@ -24,8 +37,41 @@ struct MainWindow::Impl
     QWidget * settingsBoard = nullptr;
     QHBoxLayout * settingsBoardLayout = nullptr;
 
+    QLabel * passTimings = nullptr;
+
+    // Slider moves are applied to the walls once per render, the last one only
+    std::unique_ptr<RenderScheduler> scheduler;
+    std::optional<float> pendingPhase;
+
+    enum class SceneEnum { Demo, Stress, File } scene = SceneEnum::Demo;
+    StressSceneParams stressScene; // the last one shown, or default
+    const QString sceneFileFilter = QStringLiteral("Glass wall scenes (*.gws);;All files (*)");
+
+    // Recording captures walls right before every render after a change. Playback
+    // advances a fixed step per render of the scheduler, which animates while a track
+    // plays: every visible view paints every frame before the next one is applied, so
+    // the frames are the same whatever the speed; without vsync (--no-vsync) it runs
+    // as fast as the views paint
+    std::unique_ptr<WallTrackRecorder> recorder;
+    QString recordingPath;
+    std::unique_ptr<WallTrack> track;
+    int trackFrame = -1; // applied by the last render
+    static constexpr double trackStepMs = 1000.0 / 60;
+    const QString trackFilter = QStringLiteral("Wall tracks (*.track);;All files (*)");
+
+    void StopRecording();
+    void StopPlayback();
+    void NextTrackFrame();
+
+    // Of transparent walls of WBOIT and AdditiveEP, see SceneRenderer::Accumulation()
+    int accumulationScale = 1;
+    GLsizei accumulationSamples = 1;
+    void ApplyAccumulation() const;
+
     void ArrangeWallSettings();
-    void UpdateWidgets();
+    void UpdateWidgets(); // schedules a render
+    void PrepareRender();
+    void UpdatePassTimings();
 };
 
 void MainWindow::Impl::ArrangeWallSettings()
@@ -37,6 +83,16 @@ void MainWindow::Impl::ArrangeWallSettings()
         if (!obj->metaObject()->inherits(&QLayout::staticMetaObject))
             delete obj;
 
+    // Widgets of thousands of walls would take longer than the scene itself
+    static constexpr size_t maxWallsWithSettings = 32;
+    if (GlassWall::CountOfInstances() > maxWallsWithSettings)
+    {
+        settingsBoardLayout->addWidget(new QLabel( QStringLiteral("%1 glass walls")
+                                                   .arg(GlassWall::CountOfInstances()),
+                                                   settingsBoard                        ));
+        return;
+    }
+
     std::vector<QWidget *> settingsWidgets;
     settingsWidgets.reserve(GlassWall::CountOfInstances());
     auto & iter = GlassWallIterator::Instance();
@@ -85,8 +141,60 @@ void MainWindow::Impl::ArrangeWallSettings()
         settingsBoardLayout->addWidget(*it);
 }
 
-void MainWindow::Impl::UpdateWidgets()
-{ wgt_WBOIT->update(); wgt_CODB->update(); wgt_Additive->update(); wgt_AdditiveEP->update(); }
+void MainWindow::Impl::UpdateWidgets() { scheduler->SceneChanged(); }
+
+void MainWindow::Impl::PrepareRender()
+{
+    if (pendingPhase)
+    {
+        switch (scene)
+        {
+        case SceneEnum::Demo  : UpdateDemoWalls  (*pendingPhase); break;
+        case SceneEnum::Stress: UpdateStressWalls(*pendingPhase); break;
+        case SceneEnum::File  : break; // scene files are static
+        }
+        pendingPhase.reset();
+    }
+    if (track) NextTrackFrame();
+    if (recorder) recorder->Capture();
+}
+
+void MainWindow::Impl::StopRecording()
+{
+    if (!recorder) return;
+    auto error = recorder->Save(recordingPath);
+    recorder.reset();
+    ui->statusbar->showMessage( error.isEmpty() ? QStringLiteral("Saved %1").arg(recordingPath)
+                                                : error, 5000                                  );
+}
+
+void MainWindow::Impl::StopPlayback() { track.reset(); scheduler->Animate(false); }
+
+void MainWindow::Impl::NextTrackFrame()
+{
+    if (!track) return;
+    if (++trackFrame >= track->FrameCount(trackStepMs)) { StopPlayback(); return; }
+    track->Apply(trackFrame * trackStepMs);
+}
+
+void MainWindow::Impl::ApplyAccumulation() const
+{
+    for (auto wgt : { wgt_WBOIT, wgt_AdditiveEP })
+        wgt->Accumulation(accumulationScale, accumulationSamples);
+}
+
+void MainWindow::Impl::UpdatePassTimings()
+{
+    QStringList parts;
+    for (auto wgt : { wgt_WBOIT, wgt_CODB, wgt_Additive, wgt_AdditiveEP })
+    {
+        auto summary = wgt->PassTimingsSummary();
+        if (!summary.isEmpty())
+            parts.append(QStringLiteral("%1: %2").arg(SceneRenderer::StrategyName(wgt->Strategy()),
+                                                       summary));
+    }
+    passTimings->setText(parts.join(QStringLiteral("  |  ")));
+}
 
 MainWindow::MainWindow(QWidget * parent) :
     QMainWindow(parent), impl(std::make_unique<Impl>())
@@ -117,6 +225,16 @@ MainWindow::MainWindow(QWidget * parent) :
     impl->ui->gridLayout_bottom->addWidget(impl->wgt_AdditiveEP, 1, 1);
     impl->ui->gridLayout_bottom->setRowStretch(1, 1);
 
+    impl->scheduler = std::make_unique<RenderScheduler>(std::vector<GLWidget *>{
+        impl->wgt_WBOIT, impl->wgt_CODB, impl->wgt_Additive, impl->wgt_AdditiveEP });
+    impl->scheduler->SetPrepare([this]{ impl->PrepareRender(); });
+
+    impl->passTimings = new QLabel(impl->ui->statusbar);
+    impl->ui->statusbar->addWidget(impl->passTimings);
+    for (auto wgt : { impl->wgt_WBOIT, impl->wgt_CODB, impl->wgt_Additive, impl->wgt_AdditiveEP })
+        connect( wgt, &GLWidget::PassTimingsChanged, this,
+                 [this]{ impl->UpdatePassTimings(); } );
+
     static constexpr int max = 1000;
     impl->ui->slider->setRange(0, max);
     impl->ui->slider->setValue(0);
@@ -125,106 +243,151 @@ MainWindow::MainWindow(QWidget * parent) :
              [this, max = max](int val)
              { this->UpdateWalls(static_cast<float>(val) / max); }
            );
+
+    auto sceneMenu = impl->ui->menubar->addMenu(QStringLiteral("Scene"));
+    connect( sceneMenu->addAction(QStringLiteral("Demo")), &QAction::triggered, this,
+             [this]{ InitWalls(); } );
+    connect( sceneMenu->addAction(QStringLiteral("Stress scene...")), &QAction::triggered, this,
+             [this]
+             {
+                 bool ok = false;
+                 auto spec = QInputDialog::getText( this, QStringLiteral("Stress scene"),
+                                                    QStringLiteral("Parameters:"), QLineEdit::Normal,
+                                                    StressSceneSpec(impl->stressScene), &ok          );
+                 if (!ok) return;
+                 StressSceneParams params;
+                 auto error = ParseStressSceneParams(spec, params);
+                 if (!error.isEmpty())
+                 { QMessageBox::warning(this, QStringLiteral("Stress scene"), error); return; }
+                 InitStressWalls(params);
+             } );
+    sceneMenu->addSeparator();
+
+    connect( sceneMenu->addAction(QStringLiteral("Open scene file...")), &QAction::triggered,
+             this,
+             [this]
+             {
+                 auto path = QFileDialog::getOpenFileName( this, QStringLiteral("Open scene file"),
+                                                           QString(), impl->sceneFileFilter );
+                 if (path.isEmpty()) return;
+                 auto error = LoadWalls(path);
+                 if (!error.isEmpty())
+                     QMessageBox::warning(this, QStringLiteral("Open scene file"), error);
+             } );
+    connect( sceneMenu->addAction(QStringLiteral("Save scene file...")), &QAction::triggered,
+             this,
+             [this]
+             {
+                 auto path = QFileDialog::getSaveFileName( this, QStringLiteral("Save scene file"),
+                                                           QString(), impl->sceneFileFilter );
+                 if (path.isEmpty()) return;
+                 auto error = SaveSceneFile(path);
+                 if (!error.isEmpty())
+                     QMessageBox::warning(this, QStringLiteral("Save scene file"), error);
+             } );
+
+    auto trackMenu = impl->ui->menubar->addMenu(QStringLiteral("Track"));
+    connect( trackMenu->addAction(QStringLiteral("Record...")), &QAction::triggered, this,
+             [this]
+             {
+                 auto path = QFileDialog::getSaveFileName( this, QStringLiteral("Record track"),
+                                                           QString(), impl->trackFilter      );
+                 if (path.isEmpty()) return;
+                 impl->StopRecording(); impl->StopPlayback();
+                 impl->recordingPath = path;
+                 impl->recorder = std::make_unique<WallTrackRecorder>();
+                 impl->ui->statusbar->showMessage(QStringLiteral("Recording %1").arg(path));
+             } );
+    connect( trackMenu->addAction(QStringLiteral("Stop recording")), &QAction::triggered, this,
+             [this]{ impl->StopRecording(); } );
+    connect( trackMenu->addAction(QStringLiteral("Play...")), &QAction::triggered, this,
+             [this]
+             {
+                 auto path = QFileDialog::getOpenFileName( this, QStringLiteral("Play track"),
+                                                           QString(), impl->trackFilter    );
+                 if (path.isEmpty()) return;
+                 impl->StopRecording(); impl->StopPlayback();
+                 auto track = std::make_unique<WallTrack>();
+                 auto error = track->Load(path);
+                 if (error.isEmpty() && !track->FitsScene())
+                     error = QStringLiteral("The track was recorded with a scene of another "
+                                            "count of walls");
+                 if (!error.isEmpty())
+                 { QMessageBox::warning(this, QStringLiteral("Play track"), error); return; }
+                 impl->track = std::move(track);
+                 impl->trackFrame = -1; // frame 0 goes to the next render
+                 impl->scheduler->Animate(true);
+             } );
+    auto accumulationMenu = impl->ui->menubar->addMenu(QStringLiteral("Accumulation"));
+    auto scaleGroup = new QActionGroup(this);
+    for (int scale : SceneRenderer::allAccumulationScales)
+    {
+        auto action = new QAction( scale == 1 ? QStringLiteral("Full resolution")
+                                              : QStringLiteral("1/%1 resolution").arg(scale),
+                                   scaleGroup                                               );
+        action->setCheckable(true);
+        action->setChecked(scale == impl->accumulationScale);
+        scaleGroup->addAction(action); accumulationMenu->addAction(action);
+        connect( action, &QAction::triggered, this,
+                 [this, scale]{ impl->accumulationScale = scale; impl->ApplyAccumulation(); } );
+    }
+    accumulationMenu->addSeparator();
+    auto samplesGroup = new QActionGroup(this);
+    for (GLsizei samples : { 1, 2, 4, 8 })
+    {
+        auto action = new QAction( QStringLiteral("%1x MSAA when reduced").arg(samples),
+                                   samplesGroup                                        );
+        action->setCheckable(true);
+        action->setChecked(samples == impl->accumulationSamples);
+        samplesGroup->addAction(action); accumulationMenu->addAction(action);
+        connect( action, &QAction::triggered, this,
+                 [this, samples]
+                 { impl->accumulationSamples = samples; impl->ApplyAccumulation(); } );
+    }
 }
 
 MainWindow::~MainWindow() = default;
 
-QVector2D Mult(QVector2D vec, QMatrix2x2 mat)
+// Buffers of the walls replaced are deleted in a context of the share group
+void MainWindow::InitWalls() const
 {
-    return { mat(0, 0) * vec.x() + mat(0, 1) * vec.y(),
-             mat(1, 0) * vec.x() + mat(1, 1) * vec.y()  };
+    impl->StopRecording(); impl->StopPlayback(); // the walls are replaced
+    impl->wgt_WBOIT->makeCurrent();
+    GlassWall::RemoveAllInstances();
+    InitDemoWalls();
+    impl->wgt_WBOIT->doneCurrent();
+    impl->scene = Impl::SceneEnum::Demo;
+    impl->ArrangeWallSettings();
+    UpdateWalls(static_cast<float>(impl->ui->slider->value()) / impl->ui->slider->maximum());
 }
 
-void MainWindow::InitWalls() const
+void MainWindow::InitStressWalls(const StressSceneParams & params) const
 {
-    {
-        static constexpr QVector2D a{-0.1f, -0.6f}, b{0.1f, -0.6f}, c{0.0f, -0.9f};
-        static constexpr QVector2D d{-0.1f, -0.9f}, e{0.1f, -0.9f}, f{0.0f, -0.6f};
-        QColor clrs [] = { QColor(255, 0, 0), QColor(255, 130, 0), QColor(255, 220, 0),
-                           QColor(0, 255, 0), QColor(0, 200, 255), QColor(0, 50, 255),
-                           QColor(120, 0, 255), QColor(220, 0, 200)                     };
-
-        static constexpr uint8_t count = 8;
-        static const float angleStep = 2 * g_pi_f / count;
-        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
-                                          -std::sin(angleStep), std::cos(angleStep)  };
-        static const QMatrix2x2 rot(rotdata);
-        QMatrix2x2 rot_t{};
-
-        auto & wall1 = GlassWall::MakeInstance(0, 0.5f, true, true);
-        auto & wall2 = GlassWall::MakeInstance(1, 0.5f, true, true);
-        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
-        {
-            wall1.AddTriangle( Mult(a, rot_t), Mult(b, rot_t), Mult(c, rot_t),
-                               Qt::white, clrs[i]                              );
-            wall2.AddTriangle( Mult(d, rot_t), Mult(e, rot_t), Mult(f, rot_t),
-                               Qt::white, clrs[i]                              );
-        }
-    }
-    {
-        static constexpr QVector2D a{-0.9f, -0.04f}, b{-0.9f, 0.04f}, c{0.0f, 0.0f};
-        QColor clrs [] = { QColor(10, 100, 35), QColor(10, 30, 100), QColor(110, 30, 0),
-                           QColor(10, 35, 100), QColor(100, 5, 40), QColor(0, 70, 70),
-                           QColor(30, 100, 15), QColor(100, 0, 0) };
-
-
-
-        static constexpr uint8_t count = 8;
-        static const float angleStep = 2 * g_pi_f / count;
-        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
-                                          -std::sin(angleStep), std::cos(angleStep)  };
-        static const QMatrix2x2 rot(rotdata);
-        QMatrix2x2 rot_t{};
-
-        auto & wall1 = GlassWall::MakeInstance(2, 0.5f, true, true);
-        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
-        {
-            wall1.AddTriangle( Mult(a, rot_t), Mult(b, rot_t), Mult(c, rot_t),
-                               Qt::yellow, clrs[i]                             );
-        }
-    }
-    {
-        static constexpr QVector2D a{-1.0f, 0.0f}, b{0.0f, 0.0f}, c{0.0f, 1.0f};
-        QColor clrs [] = { QColor(255, 255, 255), QColor(0, 255, 255),
-                           QColor(127, 127, 127), QColor(35, 35, 100)  };
-
-
-        static constexpr uint8_t count = 4;
-        static const float angleStep = 2 * g_pi_f / count;
-        static const float rotdata [] = {  std::cos(angleStep), std::sin(angleStep),
-                                          -std::sin(angleStep), std::cos(angleStep)  };
-        static const QMatrix2x2 rot(rotdata);
-        QMatrix2x2 rot_t{};
+    impl->StopRecording(); impl->StopPlayback(); // the walls are replaced
+    impl->wgt_WBOIT->makeCurrent();
+    ::InitStressWalls(params);
+    impl->wgt_WBOIT->doneCurrent();
+    impl->scene = Impl::SceneEnum::Stress;
+    impl->stressScene = params;
+    impl->ArrangeWallSettings();
+    UpdateWalls(static_cast<float>(impl->ui->slider->value()) / impl->ui->slider->maximum());
+}
 
-        auto & wall1 = GlassWall::MakeInstance(3, 0.5f, true, true);
-        for (auto i = 0; i < count; (++i), (rot_t = rot * rot_t))
-        {
-            wall1.AddTriangle( Mult(a, rot_t), Mult(b, rot_t), Mult(c, rot_t),
-                               clrs[i], clrs[i]                                );
-        }
-    }
+QString MainWindow::LoadWalls(const QString & path) const
+{
+    impl->StopRecording(); impl->StopPlayback(); // the walls are replaced
+    impl->wgt_WBOIT->makeCurrent();
+    auto error = LoadSceneFile(path);
+    impl->wgt_WBOIT->doneCurrent();
+    if (!error.isEmpty()) return error;
+    impl->scene = Impl::SceneEnum::File;
     impl->ArrangeWallSettings();
+    impl->UpdateWidgets();
+    return {};
 }
 
 void MainWindow::UpdateWalls(float p) const
 {
-    float angle = 2 * g_pi_f * p;
-    auto cos  = std::cos(angle    ), sin  = std::sin(angle    );
-    auto cos2 = std::cos(angle / 2), sin2 = std::sin(angle / 2);
-    float trData1 [] = {  cos ,  sin , 0,
-                         -sin ,  cos , 0,
-                            0 ,    0 , 1  };
-    float trData2 [] = {  cos , -sin , 0,
-                          sin ,  cos , 0,
-                            0 ,    0 , 1  };
-    float trData3 [] = {  cos2, -sin2, 0,
-                          sin2,  cos2, 0,
-                            0 ,    0 , 1  };
-    auto & wall1 = GlassWall::FindInstance(0);
-    wall1.Transformation(QMatrix3x3(trData1));
-    auto & wall2 = GlassWall::FindInstance(1);
-    wall2.Transformation(QMatrix3x3(trData2));
-    auto & wall3 = GlassWall::FindInstance(2);
-    wall3.Transformation(QMatrix3x3(trData3));
+    impl->pendingPhase = p;
     impl->UpdateWidgets();
 }
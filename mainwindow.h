@@ -3,6 +3,8 @@
 
 #include <QMainWindow>
 
+struct StressSceneParams;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -11,7 +13,9 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
-    void InitWalls() const;
+    void InitWalls() const; // of the demo scene
+    void InitStressWalls(const StressSceneParams & params) const;
+    QString LoadWalls(const QString & path) const; // returns an error message or an empty string
     void UpdateWalls(float p) const;
 
 private: